@@ -0,0 +1,98 @@
+#!/usr/bin/env bash
+# End-to-end overhead of gp_relaccess_stats hooks measured with pgbench.
+# Each workload is run with tracking disabled (baseline), enabled, enabled with
+# relaccess_stats_update() called concurrently and, if -O is given, enabled with
+# gp_relaccess_stats.dump_on_overflow on. TPS and average latency are reported
+# along with their deltas against the baseline.
+#
+# Usage: run.sh [-d db] [-c clients] [-T seconds] [-s scale] [-p partitions]
+#               [-w "tpcb wide_select_all wide_select_point"] [-O]
+# -O toggles dump_on_overflow with gpconfig/gpstop -u, so it needs a GP admin
+# environment. Overflow only happens if gp_relaccess_stats.max_tables is lower
+# than the number of relations touched between updates.
+set -euo pipefail
+
+DB=${PGDATABASE:-postgres}
+CLIENTS=16
+DURATION=60
+SCALE=10
+PARTS=1000
+WORKLOADS="tpcb wide_select_all wide_select_point"
+WITH_OVERFLOW=0
+
+while getopts "d:c:T:s:p:w:O" opt; do
+  case $opt in
+    d) DB=$OPTARG ;;
+    c) CLIENTS=$OPTARG ;;
+    T) DURATION=$OPTARG ;;
+    s) SCALE=$OPTARG ;;
+    p) PARTS=$OPTARG ;;
+    w) WORKLOADS=$OPTARG ;;
+    O) WITH_OVERFLOW=1 ;;
+    *) sed -n '2,13p' "$0"; exit 1 ;;
+  esac
+done
+
+HERE=$(cd "$(dirname "$0")" && pwd)
+PSQL="psql -X -q -t -A -d $DB"
+
+prepare() {
+  pgbench -i -q -s "$SCALE" "$DB" >/dev/null
+  $PSQL -v parts="$PARTS" -f "$HERE/setup.sql" >/dev/null
+  $PSQL -c "SELECT relaccess.relaccess_stats_update()" >/dev/null
+}
+
+set_dump_on_overflow() {
+  gpconfig -c gp_relaccess_stats.dump_on_overflow -v "$1" --masteronly >/dev/null
+  gpstop -u -a >/dev/null
+}
+
+update_loop() {
+  while true; do
+    $PSQL -c "SELECT relaccess.relaccess_stats_update()" >/dev/null || true
+    sleep 1
+  done
+}
+
+# prints "<tps> <latency_ms>"
+run_pgbench() {
+  local workload=$1 enabled=$2
+  PGOPTIONS="-c gp_relaccess_stats.enabled=$enabled" \
+    pgbench -n -c "$CLIENTS" -j "$CLIENTS" -T "$DURATION" \
+      -D scale="$SCALE" -D maxk=$((PARTS - 1)) \
+      -f "$HERE/$workload.sql" "$DB" |
+    awk '/latency average/ {lat = $3} /excluding connections/ {tps = $3}
+         END {print tps, lat}'
+}
+
+report() {
+  local workload=$1 config=$2 tps=$3 lat=$4 base_tps=$5 base_lat=$6
+  awk -v w="$workload" -v c="$config" -v t="$tps" -v l="$lat" \
+      -v bt="$base_tps" -v bl="$base_lat" 'BEGIN {
+    printf "%-18s %-20s %10.1f %12.3f %+9.2f%% %+9.2f%%\n", w, c, t, l,
+           (t - bt) * 100 / bt, (l - bl) * 100 / bl }'
+}
+
+prepare
+printf "%-18s %-20s %10s %12s %10s %10s\n" workload config tps latency_ms tps_delta lat_delta
+for workload in $WORKLOADS; do
+  read -r base_tps base_lat < <(run_pgbench "$workload" off)
+  report "$workload" off "$base_tps" "$base_lat" "$base_tps" "$base_lat"
+
+  read -r tps lat < <(run_pgbench "$workload" on)
+  report "$workload" on "$tps" "$lat" "$base_tps" "$base_lat"
+
+  update_loop &
+  loop_pid=$!
+  read -r tps lat < <(run_pgbench "$workload" on)
+  kill "$loop_pid"; wait "$loop_pid" 2>/dev/null || true
+  report "$workload" on+update "$tps" "$lat" "$base_tps" "$base_lat"
+
+  if [ "$WITH_OVERFLOW" = 1 ]; then
+    set_dump_on_overflow on
+    read -r tps lat < <(run_pgbench "$workload" on)
+    set_dump_on_overflow off
+    report "$workload" on+dump_on_overflow "$tps" "$lat" "$base_tps" "$base_lat"
+  fi
+  $PSQL -c "SELECT relaccess.relaccess_stats_update()" >/dev/null
+done
@@ -0,0 +1,13 @@
+-- Creates the test-only helper writing synthetic dump entries and a
+-- partitioned table, so that relaccess_stats_root_tables_aggregated has some
+-- inheritance to walk.
+-- psql -v parts=<number of partitions> -f bench/scale_setup.sql
+CREATE OR REPLACE FUNCTION relaccess.__relaccess_bench_write_dump(n_entries int, first_relid oid)
+RETURNS void
+AS '$libdir/gp_relaccess_stats', 'relaccess_bench_write_dump'
+LANGUAGE C VOLATILE EXECUTE ON MASTER;
+
+DROP TABLE IF EXISTS relaccess_bench_scale_parts;
+CREATE TABLE relaccess_bench_scale_parts (k int, v int)
+DISTRIBUTED BY (v)
+PARTITION BY RANGE (k) (START (0) END (:parts) EVERY (1));
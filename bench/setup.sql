@@ -0,0 +1,8 @@
+-- Prepares tables for the wide partition workloads.
+-- psql -v parts=<number of partitions> -f bench/setup.sql
+DROP TABLE IF EXISTS relaccess_bench_parts;
+CREATE TABLE relaccess_bench_parts (k int, v int)
+DISTRIBUTED BY (v)
+PARTITION BY RANGE (k) (START (0) END (:parts) EVERY (1));
+INSERT INTO relaccess_bench_parts SELECT i % :parts, i FROM generate_series(1, :parts * 10) i;
+ANALYZE relaccess_bench_parts;
@@ -0,0 +1,54 @@
+#!/usr/bin/env bash
+# Scalability of relaccess_stats_update() and relaccess_stats_root_tables_aggregated.
+# For every size a dump file with that many synthetic entries is written directly
+# and relaccess_stats_update() is timed twice: into an empty relaccess_stats
+# (insert path) and once more with the same relids (update path). Then a full
+# scan of relaccess_stats_root_tables_aggregated is timed.
+# Synthetic relids start from the first partition of a partitioned table, so
+# the view joins against real inheritance.
+#
+# Runs in a dedicated database which is dropped and recreated.
+# Usage: update_scale.sh [-d db] [-p partitions] [-n "10000 100000 1000000"]
+set -euo pipefail
+
+DB=relaccess_bench_scale
+PARTS=1000
+SIZES="10000 100000 1000000"
+
+while getopts "d:p:n:" opt; do
+  case $opt in
+    d) DB=$OPTARG ;;
+    p) PARTS=$OPTARG ;;
+    n) SIZES=$OPTARG ;;
+    *) sed -n '2,12p' "$0"; exit 1 ;;
+  esac
+done
+
+HERE=$(cd "$(dirname "$0")" && pwd)
+PSQL="psql -X -q -t -A -d $DB"
+
+dropdb --if-exists "$DB"
+createdb "$DB"
+$PSQL -c "CREATE EXTENSION gp_relaccess_stats"
+$PSQL -v parts="$PARTS" -f "$HERE/scale_setup.sql" >/dev/null
+FIRST_RELID=$($PSQL -c "SELECT min(inhrelid) FROM pg_inherits WHERE inhparent = 'relaccess_bench_scale_parts'::regclass")
+
+# prints elapsed milliseconds of the given statement
+timed() {
+  local start end
+  start=$(date +%s%N)
+  $PSQL -c "$1" >/dev/null
+  end=$(date +%s%N)
+  echo $(( (end - start) / 1000000 ))
+}
+
+printf "%10s %14s %14s %14s\n" entries insert_ms update_ms view_ms
+for n in $SIZES; do
+  $PSQL -c "TRUNCATE relaccess.relaccess_stats"
+  $PSQL -c "SELECT relaccess.__relaccess_bench_write_dump($n, $FIRST_RELID)" >/dev/null
+  insert_ms=$(timed "SELECT relaccess.relaccess_stats_update()")
+  $PSQL -c "SELECT relaccess.__relaccess_bench_write_dump($n, $FIRST_RELID)" >/dev/null
+  update_ms=$(timed "SELECT relaccess.relaccess_stats_update()")
+  view_ms=$(timed "SELECT count(*) FROM relaccess.relaccess_stats_root_tables_aggregated")
+  printf "%10d %14d %14d %14d\n" "$n" "$insert_ms" "$update_ms" "$view_ms"
+done
@@ -0,0 +1,2 @@
+-- scans every partition of a wide partitioned table
+SELECT count(*) FROM relaccess_bench_parts;
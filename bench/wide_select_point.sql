@@ -0,0 +1,3 @@
+-- touches a single partition of a wide partitioned table
+\setrandom k 0 :maxk
+SELECT count(*) FROM relaccess_bench_parts WHERE k = :k;
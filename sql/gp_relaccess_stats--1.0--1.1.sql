@@ -0,0 +1,336 @@
+/* gp_relaccess_stats--1.0--1.1.sql */
+
+-- complain if script is sourced in psql, rather than via ALTER EXTENSION
+\echo Use "ALTER EXTENSION gp_relaccess_stats UPDATE TO '1.1'" to load this file. \quit
+
+CREATE FUNCTION relaccess.relaccess_stats_internal(OUT name text, OUT value bigint)
+RETURNS SETOF record
+AS 'MODULE_PATHNAME', 'relaccess_stats_internal'
+LANGUAGE C VOLATILE EXECUTE ON MASTER;
+
+CREATE FUNCTION relaccess.relaccess_stats_latency(OUT histogram text, OUT bucket_upper_us bigint, OUT count bigint)
+RETURNS SETOF record
+AS 'MODULE_PATHNAME', 'relaccess_stats_latency'
+LANGUAGE C VOLATILE EXECUTE ON MASTER;
+
+CREATE FUNCTION relaccess.relaccess_stats_latency_reset()
+RETURNS void
+AS 'MODULE_PATHNAME', 'relaccess_stats_latency_reset'
+LANGUAGE C VOLATILE EXECUTE ON MASTER;
+
+CREATE FUNCTION relaccess.relaccess_stats_lost(OUT dbid oid, OUT n_lost_events bigint, OUT last_lost timestamptz)
+RETURNS SETOF record
+AS 'MODULE_PATHNAME', 'relaccess_stats_lost'
+LANGUAGE C VOLATILE EXECUTE ON MASTER;
+
+CREATE FUNCTION relaccess.__get_backend_phases(OUT pid int, OUT phase text, OUT phase_start timestamptz)
+RETURNS SETOF record
+AS 'MODULE_PATHNAME', 'relaccess_stats_activity'
+LANGUAGE C VOLATILE EXECUTE ON MASTER;
+
+-- Backends currently busy inside gp_relaccess_stats and what exactly they do
+CREATE VIEW relaccess.relaccess_stats_activity AS (
+    SELECT a.pid, a.datname, a.usename, p.phase, p.phase_start,
+        now() - p.phase_start AS phase_duration, a.query
+    FROM relaccess.__get_backend_phases() p
+    JOIN pg_catalog.pg_stat_activity a ON a.pid = p.pid
+);
+
+-- Percentiles are reported as upper bounds of the histogram bucket they fall into
+CREATE VIEW relaccess.relaccess_stats_latency_summary AS (
+    WITH running AS (
+        SELECT histogram, bucket_upper_us, count,
+            sum(count) OVER (PARTITION BY histogram ORDER BY bucket_upper_us) AS running_count,
+            sum(count) OVER (PARTITION BY histogram) AS total_count
+        FROM relaccess.relaccess_stats_latency()
+    )
+    SELECT histogram,
+        max(total_count) AS count,
+        min(CASE WHEN running_count >= 0.5 * total_count THEN bucket_upper_us END) AS p50_us,
+        min(CASE WHEN running_count >= 0.9 * total_count THEN bucket_upper_us END) AS p90_us,
+        min(CASE WHEN running_count >= 0.99 * total_count THEN bucket_upper_us END) AS p99_us,
+        min(CASE WHEN running_count >= 0.999 * total_count THEN bucket_upper_us END) AS p999_us,
+        max(bucket_upper_us) AS max_us
+    FROM running GROUP BY histogram
+);
+
+CREATE FUNCTION relaccess.relaccess_stats_fill_rate()
+RETURNS float8
+AS 'MODULE_PATHNAME', 'relaccess_stats_fill_rate'
+LANGUAGE C VOLATILE EXECUTE ON MASTER;
+
+ALTER TABLE relaccess.relaccess_stats
+    ADD COLUMN n_ddl_queries int DEFAULT 0,
+    ADD COLUMN n_rewrite_queries int DEFAULT 0,
+    ADD COLUMN last_ddl timestamptz DEFAULT '2000-01-01 03:00:00',
+    ADD COLUMN last_rewrite timestamptz DEFAULT '2000-01-01 03:00:00',
+    ADD COLUMN n_nested_queries int DEFAULT 0,
+    ADD COLUMN n_aborted_queries int DEFAULT 0,
+    ADD COLUMN last_aborted timestamptz DEFAULT '2000-01-01 03:00:00',
+    ADD COLUMN aborted_time_ms bigint DEFAULT 0,
+    ADD COLUMN n_refresh_queries int DEFAULT 0,
+    ADD COLUMN last_refresh timestamptz DEFAULT '2000-01-01 03:00:00',
+    ADD COLUMN refresh_time_ms bigint DEFAULT 0,
+    ADD COLUMN refresh_rows bigint DEFAULT 0,
+    ADD COLUMN n_usage_queries int DEFAULT 0;
+
+CREATE OR REPLACE FUNCTION relaccess.__relaccess_upsert_from_dump_file() RETURNS VOID
+LANGUAGE plpgsql VOLATILE AS
+$func$
+BEGIN
+    EXECUTE 'DROP TABLE IF EXISTS relaccess_stats_tmp';
+    EXECUTE 'CREATE TEMP TABLE relaccess_stats_tmp (LIKE relaccess.relaccess_stats) distributed by (relid)';
+    EXECUTE 'DROP TABLE IF EXISTS relaccess_stats_tmp_aggregated';
+    EXECUTE 'CREATE TEMP TABLE relaccess_stats_tmp_aggregated (LIKE relaccess.relaccess_stats) distributed by (relid)';
+    EXECUTE 'INSERT INTO relaccess_stats_tmp SELECT * FROM relaccess.__get_db_stats_from_dump()';
+    EXECUTE 'WITH aggregated_wo_relname_and_user AS (
+        SELECT relid, max(last_read) AS last_read, max(last_write) AS last_write, sum(n_select_queries) AS n_select_queries,
+            sum(n_insert_queries) AS n_insert_queries, sum(n_update_queries) AS n_update_queries, sum(n_delete_queries) AS n_delete_queries, sum(n_truncate_queries) AS n_truncate_queries,
+            sum(n_ddl_queries) AS n_ddl_queries, sum(n_rewrite_queries) AS n_rewrite_queries, max(last_ddl) AS last_ddl, max(last_rewrite) AS last_rewrite, sum(n_nested_queries) AS n_nested_queries, sum(n_aborted_queries) AS n_aborted_queries, max(last_aborted) AS last_aborted, sum(aborted_time_ms) AS aborted_time_ms, sum(n_refresh_queries) AS n_refresh_queries, max(last_refresh) AS last_refresh, sum(refresh_time_ms) AS refresh_time_ms, sum(refresh_rows) AS refresh_rows, sum(n_usage_queries) AS n_usage_queries
+        FROM relaccess_stats_tmp GROUP BY relid
+    )
+    INSERT INTO relaccess_stats_tmp_aggregated
+    SELECT relid,
+        (SELECT relname FROM relaccess_stats_tmp w WHERE w.relid = wo.relid AND greatest(wo.last_read, wo.last_write) IN (w.last_read, w.last_write) LIMIT 1) AS relname,
+        (SELECT last_reader_id FROM relaccess_stats_tmp w WHERE w.relid = wo.relid AND wo.last_read = w.last_read LIMIT 1) AS last_reader_id,
+        (SELECT last_writer_id FROM relaccess_stats_tmp w WHERE w.relid = wo.relid AND wo.last_write = w.last_write LIMIT 1) AS last_writer_id,
+        last_read,
+        last_write,
+        n_select_queries,
+        n_insert_queries,
+        n_update_queries,
+        n_delete_queries,
+        n_truncate_queries,
+        n_ddl_queries,
+        n_rewrite_queries,
+        last_ddl,
+        last_rewrite,
+        n_nested_queries,
+        n_aborted_queries,
+        last_aborted,
+        aborted_time_ms,
+        n_refresh_queries,
+        last_refresh,
+        refresh_time_ms,
+        refresh_rows,
+        n_usage_queries FROM aggregated_wo_relname_and_user AS wo';
+    EXECUTE 'DROP TABLE IF EXISTS relaccess_stats_tmp';
+    EXECUTE 'INSERT INTO relaccess.relaccess_stats
+        SELECT relid, relname, last_reader_id, last_writer_id, last_read, last_write, 0, 0, 0, 0, 0, 0, 0, last_ddl, last_rewrite, 0, 0, last_aborted, 0, 0, last_refresh, 0, 0, 0
+        FROM relaccess_stats_tmp_aggregated stage
+        WHERE NOT EXISTS (
+            SELECT 1 FROM relaccess.relaccess_stats orig WHERE orig.relid = stage.relid)';
+    EXECUTE 'UPDATE relaccess.relaccess_stats orig SET
+        relname = stage.relname,
+        n_select_queries = orig.n_select_queries + stage.n_select_queries,
+        n_insert_queries = orig.n_insert_queries + stage.n_insert_queries,
+        n_update_queries = orig.n_update_queries + stage.n_update_queries,
+        n_delete_queries = orig.n_delete_queries + stage.n_delete_queries,
+        n_truncate_queries = orig.n_truncate_queries + stage.n_truncate_queries,
+        n_ddl_queries = orig.n_ddl_queries + stage.n_ddl_queries,
+        n_rewrite_queries = orig.n_rewrite_queries + stage.n_rewrite_queries,
+        last_ddl = greatest(orig.last_ddl, stage.last_ddl),
+        last_rewrite = greatest(orig.last_rewrite, stage.last_rewrite),
+        n_nested_queries = orig.n_nested_queries + stage.n_nested_queries,
+        n_aborted_queries = orig.n_aborted_queries + stage.n_aborted_queries,
+        last_aborted = greatest(orig.last_aborted, stage.last_aborted),
+        aborted_time_ms = orig.aborted_time_ms + stage.aborted_time_ms,
+        n_refresh_queries = orig.n_refresh_queries + stage.n_refresh_queries,
+        last_refresh = greatest(orig.last_refresh, stage.last_refresh),
+        refresh_time_ms = orig.refresh_time_ms + stage.refresh_time_ms,
+        refresh_rows = orig.refresh_rows + stage.refresh_rows,
+        n_usage_queries = orig.n_usage_queries + stage.n_usage_queries
+    FROM relaccess_stats_tmp_aggregated stage
+        WHERE orig.relid = stage.relid';
+    EXECUTE 'UPDATE relaccess.relaccess_stats orig SET
+        last_reader_id = stage.last_reader_id, last_read = stage.last_read
+    FROM relaccess_stats_tmp_aggregated stage
+        WHERE orig.relid = stage.relid AND orig.last_read < stage.last_read';
+    EXECUTE 'UPDATE relaccess.relaccess_stats orig SET
+        last_writer_id = stage.last_writer_id, last_write = stage.last_write
+    FROM relaccess_stats_tmp_aggregated stage
+        WHERE orig.relid = stage.relid AND orig.last_write < stage.last_write';
+    EXECUTE 'DROP TABLE IF EXISTS relaccess_stats_tmp_aggregated';
+END
+$func$;
+
+CREATE OR REPLACE FUNCTION relaccess.relaccess_stats_init() RETURNS VOID AS
+$$
+    WITH relations AS (
+        SELECT oid as relid, relname, relowner FROM pg_catalog.pg_class WHERE relkind in ('r', 'v', 'm', 'f', 'p', 'S') AND relpersistence <> 't'
+    )
+    INSERT INTO relaccess.relaccess_stats
+        SELECT relid, relname, relowner, relowner, '2000-01-01 03:00:00', '2000-01-01 03:00:00', 0, 0, 0, 0, 0,
+            0, 0, '2000-01-01 03:00:00', '2000-01-01 03:00:00', 0, 0, '2000-01-01 03:00:00', 0, 0, '2000-01-01 03:00:00', 0, 0, 0
+        FROM relations AS all_rels WHERE NOT EXISTS(SELECT 1 FROM relaccess.relaccess_stats orig WHERE orig.relid = all_rels.relid);
+$$ LANGUAGE SQL VOLATILE;
+
+-- This utility view shows **ONLY** stats on **EXISTING** partitioned tables in aggregated form
+CREATE OR REPLACE VIEW relaccess.relaccess_stats_root_tables_aggregated AS (
+    WITH RECURSIVE parents AS (
+        SELECT inhrelid AS child, inhparent AS parent FROM pg_inherits
+        UNION ALL
+        SELECT prev.child, next.inhparent AS parent FROM parents AS prev JOIN pg_inherits AS next ON prev.parent = next.inhrelid
+    ), part_to_root_mapping AS (
+        SELECT DISTINCT child AS partid, min(parent) OVER (partition BY child) AS rootid FROM parents
+    ), parts_including_roots AS (
+        SELECT rootid as partid, rootid FROM (SELECT DISTINCT rootid FROM part_to_root_mapping) AS p
+        UNION
+        SELECT * FROM part_to_root_mapping
+    ), with_root_id AS (
+        SELECT part_tbl.rootid, stats.* FROM relaccess.relaccess_stats stats JOIN parts_including_roots part_tbl ON (stats.relid = part_tbl.partid)
+    ), without_last_user AS (
+        SELECT rootid AS relid,
+            rootid::regclass::text AS relname,
+            max(last_read) AS last_read,
+            max(last_write) AS last_write,
+            sum(n_select_queries) AS n_select_queries,
+            sum(n_insert_queries) AS n_insert_queries,
+            sum(n_update_queries) AS n_update_queries,
+            sum(n_delete_queries) AS n_delete_queries,
+            sum(n_truncate_queries) AS n_truncate_queries,
+            sum(n_ddl_queries) AS n_ddl_queries,
+            sum(n_rewrite_queries) AS n_rewrite_queries,
+            max(last_ddl) AS last_ddl,
+            max(last_rewrite) AS last_rewrite,
+            sum(n_nested_queries) AS n_nested_queries,
+            sum(n_aborted_queries) AS n_aborted_queries,
+            max(last_aborted) AS last_aborted,
+            sum(aborted_time_ms) AS aborted_time_ms,
+            sum(n_refresh_queries) AS n_refresh_queries,
+            max(last_refresh) AS last_refresh,
+            sum(refresh_time_ms) AS refresh_time_ms,
+            sum(refresh_rows) AS refresh_rows,
+            sum(n_usage_queries) AS n_usage_queries
+        FROM with_root_id outer_tbl GROUP BY rootid
+    )
+    SELECT relid,
+        relname,
+        (SELECT last_reader_id FROM with_root_id w WHERE w.rootid = wo.relid AND wo.last_read = w.last_read LIMIT 1) AS last_reader_id,
+        (SELECT last_writer_id FROM with_root_id w WHERE w.rootid = wo.relid AND wo.last_write = w.last_write LIMIT 1) AS last_writer_id,
+        last_read,
+        last_write,
+        n_select_queries,
+        n_insert_queries,
+        n_update_queries,
+        n_delete_queries,
+        n_truncate_queries,
+        n_ddl_queries,
+        n_rewrite_queries,
+        last_ddl,
+        last_rewrite,
+        n_nested_queries,
+        n_aborted_queries,
+        last_aborted,
+        aborted_time_ms,
+        n_refresh_queries,
+        last_refresh,
+        refresh_time_ms,
+        refresh_rows,
+        n_usage_queries
+    FROM without_last_user wo
+);
+
+CREATE FUNCTION relaccess.relaccess_stats_dimensions(OUT dbid oid, OUT relid oid, OUT dimension_type text, OUT dimension text,
+    OUT n_reads bigint, OUT n_writes bigint, OUT max_overcount bigint, OUT last_access timestamptz)
+RETURNS SETOF record
+AS 'MODULE_PATHNAME', 'relaccess_stats_dimensions'
+LANGUAGE C VOLATILE EXECUTE ON MASTER;
+
+CREATE FUNCTION relaccess.relaccess_stats_dimensions_reset()
+RETURNS void
+AS 'MODULE_PATHNAME', 'relaccess_stats_dimensions_reset'
+LANGUAGE C VOLATILE EXECUTE ON MASTER;
+
+-- Accesses to tables of the current database broken down by gp_relaccess_stats.dimension
+CREATE VIEW relaccess.relaccess_stats_by_dimension AS (
+    SELECT d.relid, c.relname, d.dimension_type, d.dimension, d.n_reads, d.n_writes, d.max_overcount, d.last_access
+    FROM relaccess.relaccess_stats_dimensions() d
+    LEFT JOIN pg_catalog.pg_class c ON c.oid = d.relid
+    WHERE d.dbid = (SELECT oid FROM pg_catalog.pg_database WHERE datname = current_database())
+);
+
+CREATE FUNCTION relaccess.relaccess_stats_view_links(OUT dbid oid, OUT viewid oid, OUT relid oid,
+    OUT n_queries bigint, OUT last_access timestamptz)
+RETURNS SETOF record
+AS 'MODULE_PATHNAME', 'relaccess_stats_view_links'
+LANGUAGE C VOLATILE EXECUTE ON MASTER;
+
+CREATE FUNCTION relaccess.relaccess_stats_view_links_reset()
+RETURNS void
+AS 'MODULE_PATHNAME', 'relaccess_stats_view_links_reset'
+LANGUAGE C VOLATILE EXECUTE ON MASTER;
+
+-- Queries of the current database that accessed a base table through a view
+CREATE VIEW relaccess.relaccess_stats_by_view AS (
+    SELECT l.viewid, v.relname AS viewname, l.relid, c.relname, l.n_queries, l.last_access
+    FROM relaccess.relaccess_stats_view_links() l
+    LEFT JOIN pg_catalog.pg_class v ON v.oid = l.viewid
+    LEFT JOIN pg_catalog.pg_class c ON c.oid = l.relid
+    WHERE l.dbid = (SELECT oid FROM pg_catalog.pg_database WHERE datname = current_database())
+);
+
+CREATE FUNCTION relaccess.relaccess_stats_rates(OUT dbid oid, OUT relid oid,
+    OUT reads_per_sec float8, OUT writes_per_sec float8, OUT last_access timestamptz)
+RETURNS SETOF record
+AS 'MODULE_PATHNAME', 'relaccess_stats_rates'
+LANGUAGE C VOLATILE EXECUTE ON MASTER;
+
+CREATE FUNCTION relaccess.relaccess_stats_rates_reset()
+RETURNS void
+AS 'MODULE_PATHNAME', 'relaccess_stats_rates_reset'
+LANGUAGE C VOLATILE EXECUTE ON MASTER;
+
+-- Current access rates of tables of the current database
+CREATE VIEW relaccess.relaccess_stats_by_rate AS (
+    SELECT r.relid, c.relname, r.reads_per_sec, r.writes_per_sec, r.last_access
+    FROM relaccess.relaccess_stats_rates() r
+    LEFT JOIN pg_catalog.pg_class c ON c.oid = r.relid
+    WHERE r.dbid = (SELECT oid FROM pg_catalog.pg_database WHERE datname = current_database())
+);
+
+CREATE FUNCTION relaccess.relaccess_stats_top(OUT dbid oid, OUT relid oid,
+    OUT reads_per_sec float8, OUT writes_per_sec float8, OUT last_access timestamptz)
+RETURNS SETOF record
+AS 'MODULE_PATHNAME', 'relaccess_stats_top'
+LANGUAGE C VOLATILE EXECUTE ON MASTER;
+
+-- Tables of the current database among the hottest ones of the cluster, hottest first
+CREATE VIEW relaccess.relaccess_stats_by_top AS (
+    SELECT r.relid, c.relname, r.reads_per_sec, r.writes_per_sec, r.last_access
+    FROM relaccess.relaccess_stats_top() r
+    LEFT JOIN pg_catalog.pg_class c ON c.oid = r.relid
+    WHERE r.dbid = (SELECT oid FROM pg_catalog.pg_database WHERE datname = current_database())
+    ORDER BY r.reads_per_sec + r.writes_per_sec DESC
+);
+
+CREATE FUNCTION relaccess.relaccess_stats_cold(before timestamptz, OUT dbid oid, OUT relid oid,
+    OUT last_read timestamptz, OUT last_write timestamptz)
+RETURNS SETOF record
+AS 'MODULE_PATHNAME', 'relaccess_stats_cold'
+LANGUAGE C VOLATILE EXECUTE ON MASTER;
+
+CREATE FUNCTION relaccess.relaccess_stats_cold_reset()
+RETURNS void
+AS 'MODULE_PATHNAME', 'relaccess_stats_cold_reset'
+LANGUAGE C VOLATILE EXECUTE ON MASTER;
+
+CREATE FUNCTION relaccess.relaccess_stats_sketch_estimate(relid oid, OUT n_select_queries bigint,
+    OUT n_insert_queries bigint, OUT n_update_queries bigint, OUT n_delete_queries bigint,
+    OUT n_truncate_queries bigint)
+RETURNS record
+AS 'MODULE_PATHNAME', 'relaccess_stats_sketch_estimate'
+LANGUAGE C VOLATILE EXECUTE ON MASTER;
+
+CREATE FUNCTION relaccess.relaccess_stats_sketch_reset()
+RETURNS void
+AS 'MODULE_PATHNAME', 'relaccess_stats_sketch_reset'
+LANGUAGE C VOLATILE EXECUTE ON MASTER;
+
+CREATE FUNCTION relaccess.relaccess_stats_sketch_hitters(OUT dbid oid, OUT relid oid,
+    OUT relname text, OUT n_reads bigint, OUT n_writes bigint,
+    OUT last_reader_id oid, OUT last_writer_id oid, OUT last_read timestamptz,
+    OUT last_write timestamptz)
+RETURNS SETOF record
+AS 'MODULE_PATHNAME', 'relaccess_stats_sketch_hitters'
+LANGUAGE C VOLATILE EXECUTE ON MASTER;
@@ -1,27 +1,42 @@
 #include "postgres.h"
+#include "access/transam.h"
 #include "access/xact.h"
 #include "access/hash.h"
+#include "access/heapam.h"
+#include "catalog/namespace.h"
 #include "catalog/objectaccess.h"
+#include "catalog/pg_class.h"
 #include "catalog/pg_database.h"
+#include "catalog/pg_inherits_fn.h"
 #include "cdb/cdbvars.h"
 #include "commands/dbcommands.h"
 #include "executor/executor.h"
 #include "executor/spi.h"
 #include "funcapi.h"
+#include "libpq/libpq-be.h"
 #include "miscadmin.h"
+#include "parser/parse_clause.h"
+#include "parser/parsetree.h"
 #include "pg_config_ext.h"
 #include "pgstat.h"
+#include "portability/instr_time.h"
+#include "postmaster/autovacuum.h"
 #include "storage/ipc.h"
 #include "storage/lwlock.h"
 #include "storage/shmem.h"
 #include "storage/spin.h"
 #include "utils/builtins.h"
 #include "utils/datetime.h"
+#include "utils/inval.h"
 #include "utils/lsyscache.h"
 #include "utils/memutils.h"
+#include "utils/resgroup.h"
+#include "utils/syscache.h"
 #include "utils/timestamp.h"
 #include "tcop/utility.h"
 
+#include <ctype.h>
+#include <math.h>
 #include <stdlib.h>
 #include <unistd.h>
 
@@ -33,17 +48,28 @@
  *
  * To track those actions we use:
  * - ExecutorCheckPerms hook for select, insert, update and delete statements
- * - ProcessUtility hook for truncate statements
+ * - ProcessUtility hook for truncate, DDL and REFRESH MATERIALIZED VIEW
+ * statements. DDL is recorded with a rewrite flag if the table got a new
+ * relfilenode, refreshes with their duration and number of rows
+ * - ExecutorEnd hook for partitions actually scanned by a query on their root.
+ * Those only get their timestamps updated, as the query is already counted for
+ * the root. Sequences used by the query are recorded there as well
  *
- * Intermediate data is stored in three hash tables.
- * One lives in shared memory and is cleaned only when dumped to disc:
+ * Intermediate data is stored in a hash table in shared memory which is
+ * cleaned only when dumped to disc:
  * - relaccesses - represents all recorded accesses since last dump to disc.
- * And two live in coordinator`s local memory and are cleaned on every commit
- * or rollback:
- * - local_access_entries - represent all record accesses in for this
- * transaction only
- * - relname_cache - maps relid to relname for relations used in this
- * transaction only
+ * And in coordinator`s local memory, cleaned on every commit or rollback:
+ * - local_accesses - append-only array of all record accesses in this
+ * transaction only. It is sorted and collapsed on commit, so that a query
+ * touching thousands of partitions costs a plain array append per relation.
+ * Each subtransaction owns the tail of the array starting at the offset saved
+ * in subxact_offsets, which is marked as aborted on subtransaction abort, or
+ * simply cut off if aborted statements are not tracked
+ * - relname_cache - maps relid to relname and relpersistence for relations
+ * used in this transaction only
+ * Besides, inheritance_cache maps a table to all of its inheritors for
+ * TRUNCATE statements. It is dropped whenever pg_inherits changes, as reported
+ * by the INHRELID syscache callback.
  *
  * Ultimately all recorded stats should end up in relaccess_stats table when a
  * user executes relaccess_stats_update(). But any intermediate stats will be
@@ -54,7 +80,9 @@
  * In this case stats are offloaded to disc into pg_stat directory into separate
  * file per each tracked database: pg_stat/relaccess_stats_dump_<dbid>.csv Those
  * files are upserted into relaccess_stats when relaccess_stats_update() is
- * called
+ * called. Despite the name, files are binary: relaccessDumpHeader followed by
+ * relaccessEntry records. Files without the header come from version 1.0 and
+ * hold relaccessEntryV1 records.
  */
 
 PG_MODULE_MAGIC;
@@ -64,35 +92,97 @@ void _PG_fini(void);
 PG_FUNCTION_INFO_V1(relaccess_stats_update);
 PG_FUNCTION_INFO_V1(relaccess_stats_dump);
 PG_FUNCTION_INFO_V1(relaccess_stats_fillfactor);
+PG_FUNCTION_INFO_V1(relaccess_stats_fill_rate);
 PG_FUNCTION_INFO_V1(relaccess_stats_from_dump);
+PG_FUNCTION_INFO_V1(relaccess_stats_internal);
+PG_FUNCTION_INFO_V1(relaccess_stats_latency);
+PG_FUNCTION_INFO_V1(relaccess_stats_latency_reset);
+PG_FUNCTION_INFO_V1(relaccess_stats_lost);
+PG_FUNCTION_INFO_V1(relaccess_stats_activity);
+PG_FUNCTION_INFO_V1(relaccess_stats_dimensions);
+PG_FUNCTION_INFO_V1(relaccess_stats_dimensions_reset);
+PG_FUNCTION_INFO_V1(relaccess_stats_view_links);
+PG_FUNCTION_INFO_V1(relaccess_stats_view_links_reset);
+PG_FUNCTION_INFO_V1(relaccess_stats_rates);
+PG_FUNCTION_INFO_V1(relaccess_stats_rates_reset);
+PG_FUNCTION_INFO_V1(relaccess_stats_top);
+PG_FUNCTION_INFO_V1(relaccess_stats_cold);
+PG_FUNCTION_INFO_V1(relaccess_stats_cold_reset);
+PG_FUNCTION_INFO_V1(relaccess_stats_sketch_estimate);
+PG_FUNCTION_INFO_V1(relaccess_stats_sketch_reset);
+PG_FUNCTION_INFO_V1(relaccess_stats_sketch_hitters);
+PG_FUNCTION_INFO_V1(relaccess_bench_merge);
+PG_FUNCTION_INFO_V1(relaccess_bench_write_dump);
 
 static void relaccess_stats_update_internal(void);
 static void relaccess_dump_to_files(bool only_this_db);
-static void relaccess_dump_to_files_internal(HTAB *files);
+static int64 relaccess_dump_to_files_internal(HTAB *files);
 static void relaccess_upsert_from_file(void);
 static void relaccess_shmem_startup(void);
 static void relaccess_shmem_shutdown(int code, Datum arg);
 static uint32 relaccess_hash_fn(const void *key, Size keysize);
+static uint32 relaccess_dim_hash_fn(const void *key, Size keysize);
 static int relaccess_match_fn(const void *key1, const void *key2, Size keysize);
-static uint32 local_relaccess_hash_fn(const void *key, Size keysize);
-static int local_relaccess_match_fn(const void *key1, const void *key2,
-                                    Size keysize);
 static bool collect_relaccess_hook(List *rangeTable, bool ereport_on_violation);
 static void relaccess_xact_callback(XactEvent event, void *arg);
-static void collect_truncate_hook(Node *parsetree, const char *queryString,
-                                  ProcessUtilityContext context,
-                                  ParamListInfo params, DestReceiver *dest,
-                                  char *completionTag);
+static void relaccess_subxact_callback(SubXactEvent event,
+                                       SubTransactionId mySubid,
+                                       SubTransactionId parentSubid,
+                                       void *arg);
+static void relaccess_merge_local_entries(Oid dbid, TimestampTz aborted_at);
+static void update_fill_rate(TimestampTz now);
+static bool need_predictive_dump(long n_incoming);
+static void relaccess_dump_if_requested(void);
+static void collect_utility_hook(Node *parsetree, const char *queryString,
+                                 ProcessUtilityContext context,
+                                 ParamListInfo params, DestReceiver *dest,
+                                 char *completionTag);
+static int get_ddl_targets(Node *parsetree, Oid *targets);
+static Oid get_relfilenode(Oid relid);
+static bool is_database_wide_rebuild(Node *parsetree);
+static struct relfilenodeSnapshot *snapshot_relfilenodes(int *n);
+static void record_rebuilt_relations(struct relfilenodeSnapshot *snapshot,
+                                     int n);
+static void relaccess_executor_run_hook(QueryDesc *query_desc,
+                                        ScanDirection direction, long count);
+static void relaccess_executor_finish_hook(QueryDesc *query_desc);
 static void relaccess_executor_end_hook(QueryDesc *query_desc);
 static void relaccess_drop_hook(ObjectAccessType access, Oid classId,
                                 Oid objectId, int subId, void *arg);
-static void memorize_local_access_entry(Oid relid, AclMode perms);
-static void update_relname_cache(Oid relid, char *relname);
+static void relaccess_forget_database(Oid dbid);
+static void forget_dropped_relations(void);
+static void record_scanned_partitions(PlannedStmt *stmt);
+static void record_used_sequences(PlannedStmt *stmt);
+static void record_plan_partitions(Plan *plan, List *rtable, TimestampTz ts);
+static void memorize_partition_access(Index rti, List *rtable, AclMode perms,
+                                      TimestampTz ts);
+static void reset_local_accesses(void);
+static void remember_statement_end(void);
+static void remember_refresh(Oid relid, int64 time_ms, int64 rows);
+static void shift_aborted_accesses(TimestampTz aborted_at);
+static void keep_aborted_accesses(int offset, SubTransactionId mySubid);
+static bool created_in_xact(Oid relid);
+static int next_merge_batch(int *pos, TimestampTz aborted_at);
+static bool track_relation(Oid *relid);
+static bool is_session_excluded(void);
+static bool check_exclude_roles(char **newval, void **extra,
+                                GucSource source);
+static void invalidate_session_exclusion(const char *newval, void *extra);
+static void relaccess_inherits_callback(Datum arg, int cacheid,
+                                        uint32 hashvalue);
 static StringInfoData get_dump_filename(Oid dbid);
+static List *read_dump_file(const char *filename);
+static FILE *open_dump_file_for_append(const char *filename);
+static void relaccess_lock_acquire(LWLock *lock, LWLockMode mode);
+static void flush_internal_stats(void);
+static void account_lost_event(Oid dbid);
+static void resolve_dimension(void);
 
 static shmem_startup_hook_type prev_shmem_startup_hook = NULL;
 static ExecutorCheckPerms_hook_type prev_check_perms_hook = NULL;
 static ProcessUtility_hook_type next_ProcessUtility_hook = NULL;
+static ExecutorRun_hook_type prev_ExecutorRun_hook = NULL;
+static ExecutorFinish_hook_type prev_ExecutorFinish_hook = NULL;
 static ExecutorEnd_hook_type prev_ExecutorEnd_hook = NULL;
 static object_access_hook_type prev_object_access_hook = NULL;
 
@@ -113,30 +203,446 @@ typedef struct relaccessEntry {
   int64 n_update;
   int64 n_delete;
   int64 n_truncate;
+  int64 n_ddl;
+  int64 n_rewrite;
+  TimestampTz last_ddl;
+  TimestampTz last_rewrite;
+  int64 n_nested;
+  int64 n_aborted;
+  TimestampTz last_aborted;
+  int64 aborted_time_ms;
+  int64 n_refresh;
+  TimestampTz last_refresh;
+  int64 refresh_time_ms;
+  int64 refresh_rows;
+  int64 n_usage;
 } relaccessEntry;
 
+// relaccessEntry as of version 1.0, found in dump files without a header
+typedef struct relaccessEntryV1 {
+  relaccessHashKey key;
+  char relname[NAMEDATALEN];
+  Oid last_reader_id;
+  Oid last_writer_id;
+  TimestampTz last_read;
+  TimestampTz last_write;
+  int64 n_select;
+  int64 n_insert;
+  int64 n_update;
+  int64 n_delete;
+  int64 n_truncate;
+} relaccessEntryV1;
+
+#define RELACCESS_DUMP_MAGIC 0x52414453 /* "RADS" */
+
+typedef struct relaccessDumpHeader {
+  uint32 magic;
+  uint32 entry_size;
+} relaccessDumpHeader;
+
+/**
+ * Counters describing the cost of the extension itself. Backends accumulate
+ * them in local_stats and add them to the shared copy at the end of each
+ * transaction, so hooks never touch shared memory just to count.
+ */
+typedef struct relaccessInternalStats {
+  int64 hook_calls;
+  int64 entries_merged;
+  int64 ht_lock_acquires;
+  int64 ht_lock_waits;
+  int64 ht_lock_wait_us;
+  int64 file_lock_acquires;
+  int64 file_lock_waits;
+  int64 file_lock_wait_us;
+  int64 dumps;
+  int64 dumped_entries;
+  int64 dumped_bytes;
+  int64 dump_us;
+  int64 overflows;
+  int64 dropped_entries;
+  int64 auto_dumps;
+  int64 dimension_evictions;
+  int64 dropped_view_links;
+  int64 rate_evictions;
+  int64 time_slot_evictions;
+  int64 sketched_entries;
+  int64 hitter_evictions;
+} relaccessInternalStats;
+
+/**
+ * Log-scale latency histograms. Bucket 0 counts durations below 1us, bucket i
+ * counts durations in [2^(i-1), 2^i) microseconds. The last bucket is open.
+ */
+#define LATENCY_BUCKETS 32
+
+typedef enum relaccessLatencyKind {
+  LATENCY_COMMIT_MERGE,
+  LATENCY_COLLECT_HOOK,
+  LATENCY_DUMP,
+  LATENCY_KINDS
+} relaccessLatencyKind;
+
+static const char *const latency_kind_names[LATENCY_KINDS] = {
+    "commit_merge", "collect_hook", "dump"};
+
+typedef struct relaccessLatencyHistogram {
+  int64 buckets[LATENCY_BUCKETS];
+} relaccessLatencyHistogram;
+
+static void record_latency(relaccessLatencyKind kind, instr_time duration);
+
+/**
+ * Per database accounting of relation events we had to drop because
+ * gp_relaccess_stats.max_tables was exceeded. Protected by relaccess_ht_lock.
+ */
+typedef struct relaccessLostEntry {
+  Oid dbid;
+  int64 n_lost;
+  TimestampTz last_lost;
+} relaccessLostEntry;
+
+/**
+ * Session attribute accesses can additionally be broken down by, see
+ * gp_relaccess_stats.dimension
+ */
+typedef enum relaccessDimension {
+  DIMENSION_NONE,
+  DIMENSION_APPLICATION_NAME,
+  DIMENSION_RESOURCE_GROUP,
+  DIMENSION_CLIENT_ADDR
+} relaccessDimension;
+
+static const struct config_enum_entry dimension_options[] = {
+    {"none", DIMENSION_NONE, false},
+    {"application_name", DIMENSION_APPLICATION_NAME, false},
+    {"resource_group", DIMENSION_RESOURCE_GROUP, false},
+    {"client_addr", DIMENSION_CLIENT_ADDR, false},
+    {NULL, 0, false}};
+
+typedef struct relaccessDimKey {
+  Oid dbid;
+  Oid relid;
+  relaccessDimension kind;
+  // zero padded, as keys are compared bytewise
+  char value[NAMEDATALEN];
+} relaccessDimKey;
+
+typedef struct relaccessViewLinkKey {
+  Oid dbid;
+  Oid viewid;
+  Oid relid;
+} relaccessViewLinkKey;
+
+/**
+ * How many queries accessed a base table through a view. Protected by
+ * relaccess_ht_lock. Once gp_relaccess_stats.max_view_links is reached, new
+ * links are dropped until relaccess_stats_view_links_reset().
+ */
+typedef struct relaccessViewLinkEntry {
+  relaccessViewLinkKey key;
+  int64 n_queries;
+  TimestampTz last_access;
+} relaccessViewLinkEntry;
+
+/**
+ * Per (database, relation, dimension value) counters. Protected by
+ * relaccess_ht_lock. Once gp_relaccess_stats.max_dimension_entries is reached,
+ * the least accessed entry is replaced with the new one, which inherits its
+ * counter as overcount (Space-Saving algorithm). This way heavy hitters are
+ * always kept, and counts of any entry are overestimated by overcount at most.
+ * The least accessed entry is found at the root of relaccess_dim_heap.
+ */
+typedef struct relaccessDimEntry {
+  relaccessDimKey key;
+  int64 n_reads;
+  int64 n_writes;
+  int64 overcount;
+  TimestampTz last_access;
+  // position in relaccess_dim_heap
+  int heap_pos;
+} relaccessDimEntry;
+
+/**
+ * Binary min-heap of pointers to entries of a shared hashtable, which never
+ * move as our hashtables have a fixed size. Every entry keeps its position in
+ * the heap at pos_offset, -1 if it is not there, so that its score can be
+ * changed or it can be removed in O(log n).
+ */
+typedef struct relaccessMinHeapItem {
+  void *entry;
+  double score;
+} relaccessMinHeapItem;
+
+typedef struct relaccessMinHeap {
+  int n;
+  int capacity;
+  Size pos_offset;
+  // capacity items, see relaccess_minheap_size()
+  relaccessMinHeapItem items[1];
+} relaccessMinHeap;
+
+#define MINHEAP_POS(heap, entry)                                               \
+  (*(int *)((char *)(entry) + (heap)->pos_offset))
+
+/**
+ * Exponentially weighted moving averages of queries per second, decayed
+ * lazily: rates are as of last_update and are only brought up to date by the
+ * next merge or read. Protected by relaccess_ht_lock. Unlike relaccesses, the
+ * table is not cleared by dumps.
+ *
+ * Entries are ranked by two min-heaps: relaccess_rate_heap holds all of them
+ * with the slowest one, to be evicted when the table is full, at the root, and
+ * relaccess_top holds the gp_relaccess_stats.top_size fastest ones. All rates
+ * decay at the same pace, so instead of the rate itself both rank by
+ *   score = ln(rate at last_update) + last_update / tau
+ * which orders entries exactly as their current rates do, but stays constant
+ * between accesses. Thus only merged relations need to be sifted, and the
+ * heaps only have to be rebuilt when tau changes.
+ */
+typedef struct relaccessRateEntry {
+  relaccessHashKey key;
+  double read_rate;
+  double write_rate;
+  TimestampTz last_update;
+  // positions in relaccess_rate_heap and relaccess_top, -1 if not there
+  int heap_pos;
+  int top_pos;
+} relaccessRateEntry;
+
+// maps a relation to its slot in the access time index
+typedef struct relaccessTimeSlot {
+  relaccessHashKey key;
+  int slot;
+  // position in relaccess_time_heap
+  int heap_pos;
+} relaccessTimeSlot;
+
+typedef struct relaccessSketchCell {
+  int64 n_select;
+  int64 n_insert;
+  int64 n_update;
+  int64 n_delete;
+  int64 n_truncate;
+} relaccessSketchCell;
+
+#define SKETCH_WRITES(counters)                                                \
+  ((counters)->n_insert + (counters)->n_update + (counters)->n_delete +        \
+   (counters)->n_truncate)
+
+/**
+ * Heavy hitters among sketched relations (Space-Saving over sketch estimates).
+ * Protected by relaccess_ht_lock. Counters are the sketch estimates as of the
+ * relation becoming a heavy hitter plus its exact accesses since then, see
+ * merge_shared_entry(). Timestamps are exact since it became a heavy hitter.
+ * Once gp_relaccess_stats.sketch_heavy_hitters is reached, a sketched
+ * relation replaces the one with the lowest estimate, found at the root of
+ * relaccess_hitter_heap, as soon as its own estimate is higher.
+ */
+typedef struct relaccessHitterEntry {
+  relaccessHashKey key;
+  char relname[NAMEDATALEN];
+  int64 n_reads;
+  int64 n_writes;
+  Oid last_reader_id;
+  Oid last_writer_id;
+  TimestampTz last_read;
+  TimestampTz last_write;
+  // position in relaccess_hitter_heap
+  int heap_pos;
+} relaccessHitterEntry;
+
+// a column of a set returning function
+typedef struct srfColumn {
+  const char *name;
+  Oid type;
+} srfColumn;
+
+// the most columns a set returning function built by srf_next_row() has
+#define SRF_MAX_COLUMNS 9
+
+typedef void (*srfFillRow)(void *entry, Datum *values, bool *nulls);
+
+// a row of relaccess_stats_cold()
+typedef struct coldRelation {
+  relaccessHashKey key;
+  TimestampTz last_read;
+  TimestampTz last_write;
+} coldRelation;
+
+/**
+ * What a backend is doing inside the extension right now. Every backend
+ * publishes its phase in its own slot of a shared array, so that stalls on our
+ * locks, dumps or upserts can be told apart from anything else the backend
+ * might be waiting for. See relaccess_stats_activity view.
+ */
+typedef enum relaccessPhase {
+  PHASE_NONE,
+  PHASE_HT_LOCK_WAIT,
+  PHASE_FILE_LOCK_WAIT,
+  PHASE_MERGE,
+  PHASE_DUMP,
+  PHASE_UPSERT
+} relaccessPhase;
+
+static const char *const phase_names[] = {
+    "none", "relaccess_ht_lock", "relaccess_file_lock", "merge", "dump",
+    "upsert"};
+
+typedef struct relaccessBackendPhase {
+  int pid;
+  relaccessPhase phase;
+  TimestampTz since;
+} relaccessBackendPhase;
+
+static relaccessPhase set_phase(relaccessPhase phase);
+
+typedef enum relaccessLockId {
+  RELACCESS_HT_LOCK,
+  RELACCESS_FILE_LOCK,
+  RELACCESS_N_LOCKS
+} relaccessLockId;
+
 typedef struct relaccessGlobalData {
+  // LWLocks live in our own tranches to be identifiable in lock tracing
+  LWLockPadded locks[RELACCESS_N_LOCKS];
+  int tranche_ids[RELACCESS_N_LOCKS];
   LWLock *relaccess_ht_lock;
   LWLock *relaccess_file_lock;
+  // set once we warned about overflow, cleared when there is room again
+  bool overflow_reported;
+  // smoothed growth rate of relaccesses in entries per second and the sample
+  // it was last updated from. Protected by relaccess_ht_lock
+  double fill_rate;
+  TimestampTz fill_rate_ts;
+  long fill_rate_entries;
+  // set by a commit predicting an overflow, see relaccess_dump_if_requested().
+  // Protected by relaccess_ht_lock
+  bool dump_requested;
+  // the half-life all backends decay rates with, see relaccessRateEntry.
+  // Protected by relaccess_ht_lock
+  int rate_half_life;
+  slock_t stats_lock;
+  relaccessInternalStats stats;
+  relaccessLatencyHistogram latency[LATENCY_KINDS];
+  int n_phase_slots;
+  // phase_slots entries, see relaccess_global_data_size()
+  relaccessBackendPhase phases[1];
 } relaccessGlobalData;
 
-typedef struct localAccessKey {
+// a single relation access by a single statement
+typedef struct localAccessEntry {
   Oid relid;
   int stmt_cnt;
-} localAccessKey;
-
-typedef struct localAccessEntry {
-  localAccessKey key;
-  Oid last_reader_id, last_writer_id;
-  Timestamp last_read, last_write;
   AclMode perms;
+  Oid user_id;
+  TimestampTz ts;
+  // false if only timestamps should be updated
+  bool counted;
+  // made by a statement run from a function or trigger and counted separately
+  bool nested;
+  // the view this base table was accessed through, if any
+  Oid viewid;
+  // when the subtransaction it was made in was rolled back, 0 if it was not
+  TimestampTz aborted_at;
 } localAccessEntry;
 
+// a REFRESH MATERIALIZED VIEW, kept apart as refreshes are rare
+typedef struct localRefresh {
+  Oid relid;
+  // position of its entry in local_accesses before they get sorted
+  int access;
+  int64 time_ms;
+  int64 rows;
+} localRefresh;
+
+static localAccessEntry *memorize_local_access_entry(Oid relid, AclMode perms,
+                                                      TimestampTz ts,
+                                                      bool counted);
+
+// local_accesses[..last) were made by top level statements finished at end
+typedef struct stmtEnd {
+  int last;
+  TimestampTz end;
+} stmtEnd;
+
+// all accesses to one relation in this transaction, ready to be merged
+typedef struct mergeEntry {
+  Oid relid;
+  uint32 hashvalue;
+  const char *relname; // NULL if not in relname_cache
+  // the accesses collapsed into this entry in sorted local_accesses
+  int first_access;
+  int n_accesses;
+  bool via_view;
+  Oid last_reader_id, last_writer_id;
+  TimestampTz last_read, last_write;
+  int64 n_select;
+  int64 n_insert;
+  int64 n_update;
+  int64 n_delete;
+  int64 n_truncate;
+  int64 n_ddl;
+  int64 n_rewrite;
+  TimestampTz last_ddl;
+  TimestampTz last_rewrite;
+  int64 n_nested;
+  int64 n_aborted;
+  TimestampTz last_aborted;
+  int64 aborted_time_ms;
+  int64 n_refresh;
+  TimestampTz last_refresh;
+  int64 refresh_time_ms;
+  int64 refresh_rows;
+  int64 n_usage;
+} mergeEntry;
+
+static void merge_shared_entry(Oid dbid, mergeEntry *src_entry,
+                               bool can_dump);
+static void merge_dimension_entry(Oid dbid, mergeEntry *src_entry);
+static void merge_view_links(Oid dbid, mergeEntry *src_entry);
+static void minheap_init(relaccessMinHeap *heap, int capacity,
+                         Size pos_offset);
+static void minheap_update(relaccessMinHeap *heap, void *entry, double score);
+static void minheap_remove(relaccessMinHeap *heap, void *entry);
+static void minheap_rebuild(relaccessMinHeap *heap,
+                            double (*score)(void *entry));
+static void merge_rate_entry(Oid dbid, mergeEntry *src_entry, TimestampTz now);
+static void top_update(relaccessRateEntry *entry);
+static void top_refill(void);
+static void remove_rate_entry(void *entry);
+static void merge_time_slot(Oid dbid, mergeEntry *src_entry);
+static void remove_time_slot(void *entry);
+static void sketch_add(Oid dbid, mergeEntry *src_entry);
+static void hitter_add_exact(Oid dbid, mergeEntry *src_entry);
+static void remove_hitter(void *entry);
+static void remove_dim_entry(void *entry);
+static void remove_shared_entries(HTAB *htab, Oid dbid,
+                                  void (*remove)(void *entry));
+static void reset_shared_entries(HTAB *htab, void (*remove)(void *entry));
+static FuncCallContext *srf_first_call(FunctionCallInfo fcinfo,
+                                       const srfColumn *columns,
+                                       int n_columns);
+static void *snapshot_htab(HTAB *htab, Size entrysize, int *n);
+static Datum srf_next_row(FunctionCallInfo fcinfo, Size entrysize,
+                          srfFillRow fill);
+
 typedef struct relnameCacheEntry {
   Oid relid;
   char relname[NAMEDATALEN];
+  char relpersistence;
+  char relkind;
 } relnameCacheEntry;
 
+static relnameCacheEntry *update_relname_cache(Oid relid, char *relname);
+
+typedef struct inheritanceCacheEntry {
+  Oid relid;
+  int n_inheritors;
+  Oid *inheritors;
+} inheritanceCacheEntry;
+
+static inheritanceCacheEntry *get_inheritors(Oid relid);
+
 typedef struct fileDumpEntry {
   Oid dbid;
   char *filename;
@@ -144,17 +650,200 @@ typedef struct fileDumpEntry {
 } fileDumpEntry;
 
 static int32 relaccess_size;
+static int32 max_dimension_entries;
+static int32 max_view_links;
+static int32 max_rate_entries;
+static int rate_half_life;
+// rate_half_life this backend last pushed to shared memory, 0 if none yet
+static int pushed_rate_half_life = 0;
+static int32 top_size;
+static int32 max_time_slots;
+static int32 sketch_width;
+static int32 sketch_depth;
+static int32 sketch_heavy_hitters;
+static int dimension = DIMENSION_NONE;
+// dimension value of the current transaction, resolved on its first access
+static relaccessDimension xact_dimension = DIMENSION_NONE;
+static char xact_dimension_value[NAMEDATALEN];
+static uint32 xact_dimension_hash;
+static int32 phase_slots;
+static LWLockTranche relaccess_tranches[RELACCESS_N_LOCKS];
+static const char *const tranche_names[RELACCESS_N_LOCKS] = {
+    "relaccess_ht_lock", "relaccess_file_lock"};
+static relaccessPhase current_phase = PHASE_NONE;
 static bool dump_on_overflow;
+static int dump_horizon;
+// fill rate is sampled at most once a second and smoothed over about a minute
+#define FILL_RATE_SAMPLE_USECS USECS_PER_SEC
+#define FILL_RATE_SMOOTHING_SECS 60.0
 static bool is_enabled;
+static bool track_partition_scans;
+static bool track_aborted;
+
+/**
+ * What to do with accesses made by statements that are not top level: SPI
+ * queries of functions and triggers, including referential integrity checks.
+ */
+typedef enum relaccessNestedMode {
+  NESTED_COUNT,
+  NESTED_SEPARATE,
+  NESTED_SKIP
+} relaccessNestedMode;
+
+static const struct config_enum_entry nested_accesses_options[] = {
+    {"count", NESTED_COUNT, false},
+    {"separate", NESTED_SEPARATE, false},
+    {"skip", NESTED_SKIP, false},
+    {NULL, 0, false}};
+
+static int nested_accesses = NESTED_COUNT;
+
+// what to do with accesses to temporary tables
+typedef enum relaccessTempTablesMode {
+  TEMP_TABLES_TRACK,
+  TEMP_TABLES_SKIP,
+  TEMP_TABLES_AGGREGATE
+} relaccessTempTablesMode;
+
+static const struct config_enum_entry temp_tables_options[] = {
+    {"track", TEMP_TABLES_TRACK, false},
+    {"skip", TEMP_TABLES_SKIP, false},
+    {"aggregate", TEMP_TABLES_AGGREGATE, false},
+    {NULL, 0, false}};
+
+static int temp_tables = TEMP_TABLES_AGGREGATE;
+// synthetic per database entry all temporary tables are aggregated into
+#define TEMP_TABLES_RELID InvalidOid
+#define TEMP_TABLES_RELNAME "pg_temp"
+static char *exclude_roles = NULL;
+static char *exclude_applications = NULL;
+// whether this session is excluded and for which user and application
+static bool session_excluded = false;
+static bool session_excluded_valid = false;
+static Oid session_excluded_user = InvalidOid;
+static char session_excluded_app[NAMEDATALEN];
+// depth of executor and DO block calls we are in
+static int nesting_level = 0;
+// nesting level of the REFRESH MATERIALIZED VIEW in progress, -1 if none
+static int refresh_nesting_level = -1;
+// rows produced by the query of that refresh
+static uint64 refresh_processed = 0;
 static relaccessGlobalData *data;
+// set while relaccess_bench_merge() merges into its private hashtables
+static bool bench_private = false;
 static HTAB *relaccesses;
-static HTAB *local_access_entries = NULL;
-static const int32 LOCAL_HTAB_SZ = 128;
+static HTAB *relaccess_lost;
+static HTAB *relaccess_dims = NULL;
+static relaccessMinHeap *relaccess_dim_heap = NULL;
+static HTAB *relaccess_view_links = NULL;
+static HTAB *relaccess_rates = NULL;
+static relaccessMinHeap *relaccess_rate_heap = NULL;
+static relaccessMinHeap *relaccess_top = NULL;
+/**
+ * Access time index: last access times of relations stored as a structure of
+ * arrays, so that looking for relations not accessed since a given moment is a
+ * tight loop over two contiguous timestamp arrays. Slots [0, *time_slots_used)
+ * are in use, relaccess_time_slots maps relations to them. Protected by
+ * relaccess_ht_lock and, unlike relaccesses, not cleared by dumps. Once all
+ * slots are taken, the relation accessed longest ago is evicted from the root
+ * of relaccess_time_heap. Relations not in the index were not accessed since
+ * *time_index_since: the start of the index, its reset or the last access of
+ * the most recently accessed relation evicted from it.
+ */
+static HTAB *relaccess_time_slots = NULL;
+static relaccessMinHeap *relaccess_time_heap = NULL;
+static int *time_slots_used = NULL;
+static TimestampTz *time_index_since = NULL;
+static TimestampTz *time_slot_last_read = NULL;
+static TimestampTz *time_slot_last_write = NULL;
+static Oid *time_slot_dbid = NULL;
+static Oid *time_slot_relid = NULL;
+/**
+ * Count-Min sketch of accesses to relations that are not heavy hitters:
+ * sketch_depth rows of sketch_width cells. Protected by relaccess_ht_lock.
+ * Once it is set up, relaccesses only takes heavy hitters, so it never
+ * overflows and merges never dump, however many relations are accessed.
+ */
+static relaccessSketchCell *relaccess_sketch = NULL;
+static HTAB *relaccess_hitters = NULL;
+static relaccessMinHeap *relaccess_hitter_heap = NULL;
+static const int32 LOST_HTAB_SZ = 256;
+static localAccessEntry *local_accesses = NULL;
+static int n_local_accesses = 0;
+static int local_accesses_capacity = 0;
+static const int32 LOCAL_ACCESSES_SZ = 128;
+static int *subxact_offsets = NULL;
+static int n_subxact_offsets = 0;
+static int subxact_offsets_capacity = 0;
+static const int32 SUBXACT_OFFSETS_SZ = 8;
+// only kept with track_aborted, to time statements of aborted transactions
+static stmtEnd *stmt_ends = NULL;
+static int n_stmt_ends = 0;
+static int stmt_ends_capacity = 0;
+static const int32 STMT_ENDS_SZ = 16;
+static localRefresh *local_refreshes = NULL;
+static int n_local_refreshes = 0;
+static int local_refreshes_capacity = 0;
+static const int32 LOCAL_REFRESHES_SZ = 4;
+// a relation created or dropped by this transaction and the subtransaction
+// that did it
+typedef struct xactRelation {
+  Oid relid;
+  SubTransactionId subid;
+} xactRelation;
+// relations created by this transaction, sorted before an aborted merge
+static xactRelation *created_relations = NULL;
+static int n_created_relations = 0;
+static int created_relations_capacity = 0;
+static const int32 CREATED_RELATIONS_SZ = 16;
+// relations dropped by this transaction, forgotten by the index on commit
+static xactRelation *dropped_relations = NULL;
+static int n_dropped_relations = 0;
+static int dropped_relations_capacity = 0;
+static const int32 DROPPED_RELATIONS_SZ = 16;
+// how many relations are merged per relaccess_ht_lock acquisition
+#define MERGE_BATCH_SZ 512
+static mergeEntry merge_batch[MERGE_BATCH_SZ];
 static HTAB *relname_cache = NULL;
 static const int32 RELCACHE_SZ = 16;
+static MemoryContext inheritance_cache_context = NULL;
+static HTAB *inheritance_cache = NULL;
+static bool inheritance_cache_valid = false;
+static const int32 INHCACHE_SZ = 16;
 static const int32 FILE_CACHE_SZ = 16;
 static int stmt_counter = 0;
-static bool had_ht_overflow = false;
+static relaccessInternalStats local_stats;
+static relaccessLatencyHistogram local_latency[LATENCY_KINDS];
+static bool local_stats_dirty = false;
+
+#define INTERNAL_STAT(name)                                                    \
+  { #name, offsetof(relaccessInternalStats, name) }
+
+static const struct {
+  const char *name;
+  Size offset;
+} internal_stat_names[] = {
+    INTERNAL_STAT(hook_calls),         INTERNAL_STAT(entries_merged),
+    INTERNAL_STAT(ht_lock_acquires),   INTERNAL_STAT(ht_lock_waits),
+    INTERNAL_STAT(ht_lock_wait_us),    INTERNAL_STAT(file_lock_acquires),
+    INTERNAL_STAT(file_lock_waits),    INTERNAL_STAT(file_lock_wait_us),
+    INTERNAL_STAT(dumps),              INTERNAL_STAT(dumped_entries),
+    INTERNAL_STAT(dumped_bytes),       INTERNAL_STAT(dump_us),
+    INTERNAL_STAT(overflows),          INTERNAL_STAT(dropped_entries),
+    INTERNAL_STAT(auto_dumps),         INTERNAL_STAT(dimension_evictions),
+    INTERNAL_STAT(dropped_view_links), INTERNAL_STAT(rate_evictions),
+    INTERNAL_STAT(time_slot_evictions), INTERNAL_STAT(sketched_entries),
+    INTERNAL_STAT(hitter_evictions),
+};
+
+#define LOCAL_STAT_ADD(name, value)                                            \
+  do {                                                                         \
+    local_stats.name += (value);                                               \
+    local_stats_dirty = true;                                                  \
+  } while (0)
+
+#define skip_nested_access()                                                   \
+  (nesting_level > 0 && nested_accesses == NESTED_SKIP)
 
 #define IS_POSTGRES_DB                                                         \
   (strcmp("postgres", get_database_name(MyDatabaseId)) == 0)
@@ -164,9 +853,36 @@ static bool had_ht_overflow = false;
 
 #define is_read(perms) (!is_write(perms) && ((perms)&ACL_SELECT) != 0)
 
+// pseudo privileges for local accesses, way above any ACL_* bit
+#define RELACCESS_REFRESH ((AclMode)1 << 28)
+#define RELACCESS_DDL ((AclMode)1 << 29)
+#define RELACCESS_REWRITE ((AclMode)1 << 30)
+
+static Size relaccess_global_data_size() {
+  return add_size(offsetof(relaccessGlobalData, phases),
+                  mul_size(phase_slots, sizeof(relaccessBackendPhase)));
+}
+
+static Size relaccess_minheap_size(int capacity) {
+  return add_size(offsetof(relaccessMinHeap, items),
+                  mul_size(capacity, sizeof(relaccessMinHeapItem)));
+}
+
+static Size relaccess_sketch_size() {
+  return mul_size(mul_size(sketch_width, sketch_depth),
+                  sizeof(relaccessSketchCell));
+}
+
+static Size relaccess_time_index_size() {
+  Size size = MAXALIGN(sizeof(int)) + sizeof(TimestampTz);
+  size = add_size(size, mul_size(max_time_slots, 2 * sizeof(TimestampTz)));
+  return add_size(size, mul_size(max_time_slots, 2 * sizeof(Oid)));
+}
+
 static void relaccess_shmem_startup() {
   bool found;
   HASHCTL info;
+  int i;
 
   if (prev_shmem_startup_hook)
     prev_shmem_startup_hook();
@@ -174,10 +890,31 @@ static void relaccess_shmem_startup() {
   LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
 
   data = (relaccessGlobalData *)(ShmemInitStruct(
-      "relaccess_stats", sizeof(relaccessGlobalData), &found));
+      "relaccess_stats", relaccess_global_data_size(), &found));
   if (!found) {
-    data->relaccess_ht_lock = LWLockAssign();
-    data->relaccess_file_lock = LWLockAssign();
+    for (i = 0; i < RELACCESS_N_LOCKS; i++) {
+      data->tranche_ids[i] = LWLockNewTrancheId();
+      LWLockInitialize(&data->locks[i].lock, data->tranche_ids[i]);
+    }
+    data->relaccess_ht_lock = &data->locks[RELACCESS_HT_LOCK].lock;
+    data->relaccess_file_lock = &data->locks[RELACCESS_FILE_LOCK].lock;
+    data->n_phase_slots = phase_slots;
+    memset(data->phases, 0, sizeof(relaccessBackendPhase) * phase_slots);
+    data->overflow_reported = false;
+    data->fill_rate = 0;
+    data->fill_rate_ts = 0;
+    data->fill_rate_entries = 0;
+    data->dump_requested = false;
+    data->rate_half_life = rate_half_life;
+    SpinLockInit(&data->stats_lock);
+    memset(&data->stats, 0, sizeof(data->stats));
+    memset(&data->latency, 0, sizeof(data->latency));
+  }
+  for (i = 0; i < RELACCESS_N_LOCKS; i++) {
+    relaccess_tranches[i].name = tranche_names[i];
+    relaccess_tranches[i].array_base = &data->locks[i];
+    relaccess_tranches[i].array_stride = sizeof(LWLockPadded);
+    LWLockRegisterTranche(data->tranche_ids[i], &relaccess_tranches[i]);
   }
 
   memset(&info, 0, sizeof(info));
@@ -189,6 +926,124 @@ static void relaccess_shmem_startup() {
       "relaccess_stats hash", relaccess_size, relaccess_size, &info,
       (HASH_ELEM | HASH_FUNCTION | HASH_COMPARE | HASH_FIXED_SIZE));
 
+  memset(&info, 0, sizeof(info));
+  info.keysize = sizeof(Oid);
+  info.entrysize = sizeof(relaccessLostEntry);
+  info.hash = oid_hash;
+  relaccess_lost = ShmemInitHash(
+      "relaccess_stats lost events", LOST_HTAB_SZ, LOST_HTAB_SZ, &info,
+      (HASH_ELEM | HASH_FUNCTION | HASH_FIXED_SIZE));
+
+  if (max_view_links > 0) {
+    memset(&info, 0, sizeof(info));
+    info.keysize = sizeof(relaccessViewLinkKey);
+    info.entrysize = sizeof(relaccessViewLinkEntry);
+    info.hash = tag_hash;
+    relaccess_view_links = ShmemInitHash(
+        "relaccess_stats view links", max_view_links, max_view_links, &info,
+        (HASH_ELEM | HASH_FUNCTION | HASH_FIXED_SIZE));
+  }
+
+  if (max_rate_entries > 0) {
+    memset(&info, 0, sizeof(info));
+    info.keysize = sizeof(relaccessHashKey);
+    info.entrysize = sizeof(relaccessRateEntry);
+    info.hash = tag_hash;
+    relaccess_rates = ShmemInitHash(
+        "relaccess_stats rates", max_rate_entries, max_rate_entries, &info,
+        (HASH_ELEM | HASH_FUNCTION | HASH_FIXED_SIZE));
+    relaccess_rate_heap = (relaccessMinHeap *)ShmemInitStruct(
+        "relaccess_stats rate heap", relaccess_minheap_size(max_rate_entries),
+        &found);
+    if (!found) {
+      minheap_init(relaccess_rate_heap, max_rate_entries,
+                   offsetof(relaccessRateEntry, heap_pos));
+    }
+    if (top_size > 0) {
+      relaccess_top = (relaccessMinHeap *)ShmemInitStruct(
+          "relaccess_stats top", relaccess_minheap_size(top_size), &found);
+      if (!found) {
+        minheap_init(relaccess_top, top_size,
+                     offsetof(relaccessRateEntry, top_pos));
+      }
+    }
+  }
+
+  if (max_time_slots > 0) {
+    memset(&info, 0, sizeof(info));
+    info.keysize = sizeof(relaccessHashKey);
+    info.entrysize = sizeof(relaccessTimeSlot);
+    info.hash = tag_hash;
+    relaccess_time_slots = ShmemInitHash(
+        "relaccess_stats time slots", max_time_slots, max_time_slots, &info,
+        (HASH_ELEM | HASH_FUNCTION | HASH_FIXED_SIZE));
+    char *index = ShmemInitStruct("relaccess_stats time index",
+                                  relaccess_time_index_size(), &found);
+    time_slots_used = (int *)index;
+    // timestamps go first to stay 8-byte aligned
+    index += MAXALIGN(sizeof(int));
+    time_index_since = (TimestampTz *)index;
+    if (!found) {
+      *time_slots_used = 0;
+      *time_index_since = GetCurrentTimestamp();
+    }
+    index += sizeof(TimestampTz);
+    time_slot_last_read = (TimestampTz *)index;
+    time_slot_last_write = time_slot_last_read + max_time_slots;
+    time_slot_dbid = (Oid *)(time_slot_last_write + max_time_slots);
+    time_slot_relid = time_slot_dbid + max_time_slots;
+    relaccess_time_heap = (relaccessMinHeap *)ShmemInitStruct(
+        "relaccess_stats time heap", relaccess_minheap_size(max_time_slots),
+        &found);
+    if (!found) {
+      minheap_init(relaccess_time_heap, max_time_slots,
+                   offsetof(relaccessTimeSlot, heap_pos));
+    }
+  }
+
+  if (sketch_width > 0) {
+    relaccess_sketch = (relaccessSketchCell *)ShmemInitStruct(
+        "relaccess_stats sketch", relaccess_sketch_size(), &found);
+    if (!found) {
+      memset(relaccess_sketch, 0, relaccess_sketch_size());
+    }
+    if (sketch_heavy_hitters > 0) {
+      memset(&info, 0, sizeof(info));
+      info.keysize = sizeof(relaccessHashKey);
+      info.entrysize = sizeof(relaccessHitterEntry);
+      info.hash = tag_hash;
+      relaccess_hitters = ShmemInitHash(
+          "relaccess_stats sketch hitters", sketch_heavy_hitters,
+          sketch_heavy_hitters, &info,
+          (HASH_ELEM | HASH_FUNCTION | HASH_FIXED_SIZE));
+      relaccess_hitter_heap = (relaccessMinHeap *)ShmemInitStruct(
+          "relaccess_stats hitter heap",
+          relaccess_minheap_size(sketch_heavy_hitters), &found);
+      if (!found) {
+        minheap_init(relaccess_hitter_heap, sketch_heavy_hitters,
+                     offsetof(relaccessHitterEntry, heap_pos));
+      }
+    }
+  }
+
+  if (max_dimension_entries > 0) {
+    memset(&info, 0, sizeof(info));
+    info.keysize = sizeof(relaccessDimKey);
+    info.entrysize = sizeof(relaccessDimEntry);
+    info.hash = relaccess_dim_hash_fn;
+    relaccess_dims = ShmemInitHash(
+        "relaccess_stats dimensions", max_dimension_entries,
+        max_dimension_entries, &info,
+        (HASH_ELEM | HASH_FUNCTION | HASH_FIXED_SIZE));
+    relaccess_dim_heap = (relaccessMinHeap *)ShmemInitStruct(
+        "relaccess_stats dimension heap",
+        relaccess_minheap_size(max_dimension_entries), &found);
+    if (!found) {
+      minheap_init(relaccess_dim_heap, max_dimension_entries,
+                   offsetof(relaccessDimEntry, heap_pos));
+    }
+  }
+
   LWLockRelease(AddinShmemInitLock);
 
   if (!IsUnderPostmaster) {
@@ -200,7 +1055,7 @@ static void relaccess_shmem_shutdown(int code, Datum arg) {
   if (code || !data || !relaccesses) {
     return;
   }
-  LWLockAcquire(data->relaccess_ht_lock, LW_EXCLUSIVE);
+  relaccess_lock_acquire(data->relaccess_ht_lock, LW_EXCLUSIVE);
   relaccess_dump_to_files(false);
   LWLockRelease(data->relaccess_ht_lock);
 }
@@ -210,6 +1065,23 @@ static uint32 relaccess_hash_fn(const void *key, Size keysize) {
   return hash_uint32((uint32)k->dbid) ^ hash_uint32((uint32)k->relid);
 }
 
+static uint32 dimension_hash(relaccessDimension kind, const char *value) {
+  return DatumGetUInt32(hash_uint32((uint32)kind)) ^
+         DatumGetUInt32(
+             hash_any((const unsigned char *)value, strlen(value)));
+}
+
+/**
+ * Consistent with relaccess_hash_fn(), so that a dimension entry hash is the
+ * relation hash we already have combined with the one of the transaction
+ * dimension value, computed once per transaction.
+ */
+static uint32 relaccess_dim_hash_fn(const void *key, Size keysize) {
+  const relaccessDimKey *k = (const relaccessDimKey *)key;
+  return (hash_uint32((uint32)k->dbid) ^ hash_uint32((uint32)k->relid)) ^
+         dimension_hash(k->kind, k->value);
+}
+
 static int relaccess_match_fn(const void *key1, const void *key2,
                               Size keysize) {
   const relaccessHashKey *k1 = (const relaccessHashKey *)key1;
@@ -217,16 +1089,37 @@ static int relaccess_match_fn(const void *key1, const void *key2,
   return (k1->dbid == k2->dbid && k1->relid == k2->relid) ? 0 : 1;
 }
 
-static uint32 local_relaccess_hash_fn(const void *key, Size keysize) {
-  const localAccessKey *k = (const localAccessKey *)key;
-  return hash_uint32((uint32)k->stmt_cnt) ^ hash_uint32((uint32)k->relid);
+static int local_access_cmp(const void *a, const void *b) {
+  const localAccessEntry *e1 = (const localAccessEntry *)a;
+  const localAccessEntry *e2 = (const localAccessEntry *)b;
+  if (e1->relid != e2->relid) {
+    return e1->relid < e2->relid ? -1 : 1;
+  }
+  if (e1->stmt_cnt != e2->stmt_cnt) {
+    return e1->stmt_cnt < e2->stmt_cnt ? -1 : 1;
+  }
+  if (e1->viewid != e2->viewid) {
+    return e1->viewid < e2->viewid ? -1 : 1;
+  }
+  return 0;
+}
+
+static int relid_cmp(const void *a, const void *b) {
+  Oid o1 = *(const Oid *)a;
+  Oid o2 = *(const Oid *)b;
+  if (o1 != o2) {
+    return o1 < o2 ? -1 : 1;
+  }
+  return 0;
 }
 
-static int local_relaccess_match_fn(const void *key1, const void *key2,
-                                    Size keysize) {
-  const localAccessKey *k1 = (const localAccessKey *)key1;
-  const localAccessKey *k2 = (const localAccessKey *)key2;
-  return (k1->stmt_cnt == k2->stmt_cnt && k1->relid == k2->relid) ? 0 : 1;
+static int merge_entry_hash_cmp(const void *a, const void *b) {
+  const mergeEntry *e1 = (const mergeEntry *)a;
+  const mergeEntry *e2 = (const mergeEntry *)b;
+  if (e1->hashvalue != e2->hashvalue) {
+    return e1->hashvalue < e2->hashvalue ? -1 : 1;
+  }
+  return 0;
 }
 
 void _PG_init(void) {
@@ -250,6 +1143,129 @@ void _PG_init(void) {
                            NULL, &dump_on_overflow, false, PGC_SIGHUP, 0, NULL,
                            NULL, NULL);
 
+  DefineCustomIntVariable(
+      "gp_relaccess_stats.dump_horizon",
+      "Dumps stats in advance if at the current fill rate "
+      "gp_relaccess_stats.max_tables would be exceeded sooner than that.",
+      "0 disables predictive dumps.", &dump_horizon, 0, 0, INT_MAX / 1000,
+      PGC_SIGHUP, GUC_UNIT_S, NULL, NULL, NULL);
+
+  DefineCustomBoolVariable(
+      "gp_relaccess_stats.track_partition_scans",
+      "Update timestamps of partitions actually scanned by a query on their "
+      "partitioned table.",
+      "Every scanned partition takes an entry of its own, so this adds to "
+      "the cost of merges and to gp_relaccess_stats.max_tables usage.",
+      &track_partition_scans, false, PGC_SUSET, 0, NULL, NULL, NULL);
+
+  DefineCustomBoolVariable(
+      "gp_relaccess_stats.track_aborted",
+      "Count accesses of aborted transactions as aborted queries.", NULL,
+      &track_aborted, true, PGC_SUSET, 0, NULL, NULL, NULL);
+
+  DefineCustomEnumVariable(
+      "gp_relaccess_stats.nested_accesses",
+      "Selects how accesses made by functions and triggers are tracked.",
+      "count tracks them as any other query, separate counts them as "
+      "n_nested_queries only and skip ignores them.",
+      &nested_accesses, NESTED_COUNT, nested_accesses_options, PGC_SUSET, 0,
+      NULL, NULL, NULL);
+
+  DefineCustomEnumVariable(
+      "gp_relaccess_stats.dimension",
+      "Selects a session attribute table accesses are additionally broken "
+      "down by.",
+      "See relaccess_stats_dimensions().", &dimension, DIMENSION_NONE,
+      dimension_options, PGC_SUSET, 0, NULL, NULL, NULL);
+
+  DefineCustomIntVariable(
+      "gp_relaccess_stats.max_dimension_entries",
+      "Sets the maximum number of (table, dimension value) pairs tracked by "
+      "gp_relaccess_stats.",
+      NULL, &max_dimension_entries, 4096, 0, INT_MAX, PGC_POSTMASTER, 0, NULL,
+      NULL, NULL);
+
+  DefineCustomIntVariable(
+      "gp_relaccess_stats.max_rate_entries",
+      "Sets the maximum number of relations whose access rates are estimated "
+      "by gp_relaccess_stats.",
+      "0 disables access rate estimates.", &max_rate_entries, 4096, 0,
+      INT_MAX, PGC_POSTMASTER, 0, NULL, NULL, NULL);
+
+  DefineCustomIntVariable(
+      "gp_relaccess_stats.top_size",
+      "Sets the number of relations with the highest access rates kept ready "
+      "by gp_relaccess_stats.",
+      "See relaccess_stats_top(). 0 disables it.", &top_size, 32, 0, 65536,
+      PGC_POSTMASTER, 0, NULL, NULL, NULL);
+
+  DefineCustomIntVariable(
+      "gp_relaccess_stats.sketch_width",
+      "Sets the number of counters per row of the sketch estimating accesses "
+      "to relations other than heavy hitters.",
+      "If set, only heavy hitters are tracked exactly in "
+      "gp_relaccess_stats.max_tables. 0 disables the sketch.",
+      &sketch_width, 0, 0, INT_MAX / 1024, PGC_POSTMASTER, 0, NULL, NULL,
+      NULL);
+
+  DefineCustomIntVariable(
+      "gp_relaccess_stats.sketch_depth",
+      "Sets the number of rows of the sketch estimating accesses to relations "
+      "other than heavy hitters.",
+      NULL, &sketch_depth, 4, 1, 16, PGC_POSTMASTER, 0, NULL, NULL, NULL);
+
+  DefineCustomIntVariable(
+      "gp_relaccess_stats.sketch_heavy_hitters",
+      "Sets the number of sketched relations with the most accesses that are "
+      "tracked exactly from then on.",
+      "See relaccess_stats_sketch_hitters(). Only used with "
+      "gp_relaccess_stats.sketch_width. 0 disables it.",
+      &sketch_heavy_hitters, 64, 0, 65536, PGC_POSTMASTER, 0, NULL, NULL,
+      NULL);
+
+  DefineCustomIntVariable(
+      "gp_relaccess_stats.max_time_slots",
+      "Sets the maximum number of relations whose last access times are "
+      "indexed for relaccess_stats_cold().",
+      "0 disables the index.", &max_time_slots, 16384, 0, INT_MAX / 32,
+      PGC_POSTMASTER, 0, NULL, NULL, NULL);
+
+  DefineCustomIntVariable(
+      "gp_relaccess_stats.rate_half_life",
+      "Sets the time after which an access weighs half as much in access rate "
+      "estimates.",
+      NULL, &rate_half_life, 60, 1, INT_MAX / 1000, PGC_SIGHUP, GUC_UNIT_S,
+      NULL, NULL, NULL);
+
+  DefineCustomIntVariable(
+      "gp_relaccess_stats.max_view_links",
+      "Sets the maximum number of (view, base table) pairs tracked by "
+      "gp_relaccess_stats.",
+      "0 disables attribution of base table accesses to views.",
+      &max_view_links, 4096, 0, INT_MAX, PGC_POSTMASTER, 0, NULL, NULL, NULL);
+
+  DefineCustomEnumVariable(
+      "gp_relaccess_stats.temp_tables",
+      "Selects how accesses to temporary tables are tracked.",
+      "track tracks them as any other table, skip ignores them and aggregate "
+      "records them all into a single pg_temp entry with relid 0.",
+      &temp_tables, TEMP_TABLES_AGGREGATE, temp_tables_options, PGC_SUSET, 0,
+      NULL, NULL, NULL);
+
+  DefineCustomStringVariable(
+      "gp_relaccess_stats.exclude_roles",
+      "Comma separated list of roles whose sessions are not tracked.", NULL,
+      &exclude_roles, "", PGC_SUSET, GUC_LIST_INPUT | GUC_LIST_QUOTE,
+      check_exclude_roles, invalidate_session_exclusion, NULL);
+
+  DefineCustomStringVariable(
+      "gp_relaccess_stats.exclude_applications",
+      "Comma separated list of application_name patterns whose sessions are "
+      "not tracked.",
+      "* in a pattern matches any sequence of characters.",
+      &exclude_applications, "", PGC_SUSET, GUC_LIST_INPUT, NULL,
+      invalidate_session_exclusion, NULL);
+
   DefineCustomBoolVariable(
       "gp_relaccess_stats.enabled",
       "Collect table access stats globally or for a specific database. "
@@ -261,27 +1277,61 @@ void _PG_init(void) {
   prev_check_perms_hook = ExecutorCheckPerms_hook;
   ExecutorCheckPerms_hook = collect_relaccess_hook;
   next_ProcessUtility_hook = ProcessUtility_hook;
-  ProcessUtility_hook = collect_truncate_hook;
+  ProcessUtility_hook = collect_utility_hook;
+  prev_ExecutorRun_hook = ExecutorRun_hook;
+  ExecutorRun_hook = relaccess_executor_run_hook;
+  prev_ExecutorFinish_hook = ExecutorFinish_hook;
+  ExecutorFinish_hook = relaccess_executor_finish_hook;
   prev_ExecutorEnd_hook = ExecutorEnd_hook;
   ExecutorEnd_hook = relaccess_executor_end_hook;
   prev_object_access_hook = object_access_hook;
   object_access_hook = relaccess_drop_hook;
-  RequestAddinLWLocks(2);
-  size = MAXALIGN(sizeof(relaccessGlobalData));
+  // MaxBackends is not computed yet at this point, so estimate it the same way
+  phase_slots = MaxConnections + autovacuum_max_workers + 1 +
+                max_worker_processes;
+  size = MAXALIGN(relaccess_global_data_size());
   size = add_size(size,
                   hash_estimate_size(relaccess_size, sizeof(relaccessEntry)));
+  size = add_size(size, hash_estimate_size(LOST_HTAB_SZ,
+                                           sizeof(relaccessLostEntry)));
+  if (max_rate_entries > 0) {
+    size = add_size(size, hash_estimate_size(max_rate_entries,
+                                             sizeof(relaccessRateEntry)));
+    size = add_size(size, relaccess_minheap_size(max_rate_entries));
+    if (top_size > 0) {
+      size = add_size(size, relaccess_minheap_size(top_size));
+    }
+  }
+  if (sketch_width > 0) {
+    size = add_size(size, relaccess_sketch_size());
+    if (sketch_heavy_hitters > 0) {
+      size = add_size(size, hash_estimate_size(sketch_heavy_hitters,
+                                               sizeof(relaccessHitterEntry)));
+      size = add_size(size, relaccess_minheap_size(sketch_heavy_hitters));
+    }
+  }
+  if (max_time_slots > 0) {
+    size = add_size(size, hash_estimate_size(max_time_slots,
+                                             sizeof(relaccessTimeSlot)));
+    size = add_size(size, relaccess_time_index_size());
+    size = add_size(size, relaccess_minheap_size(max_time_slots));
+  }
+  if (max_view_links > 0) {
+    size = add_size(size, hash_estimate_size(max_view_links,
+                                             sizeof(relaccessViewLinkEntry)));
+  }
+  if (max_dimension_entries > 0) {
+    size = add_size(size, hash_estimate_size(max_dimension_entries,
+                                             sizeof(relaccessDimEntry)));
+    size = add_size(size, relaccess_minheap_size(max_dimension_entries));
+  }
   RequestAddinShmemSpace(size);
   RegisterXactCallback(relaccess_xact_callback, NULL);
+  RegisterSubXactCallback(relaccess_subxact_callback, NULL);
+  CacheRegisterSyscacheCallback(INHRELID, relaccess_inherits_callback,
+                                (Datum)0);
   HASHCTL ctl;
   MemSet(&ctl, 0, sizeof(ctl));
-  ctl.keysize = sizeof(localAccessKey);
-  ctl.entrysize = sizeof(localAccessEntry);
-  ctl.hash = local_relaccess_hash_fn;
-  ctl.match = local_relaccess_match_fn;
-  local_access_entries =
-      hash_create("Transaction-wide relaccess entries", LOCAL_HTAB_SZ, &ctl,
-                  HASH_ELEM | HASH_FUNCTION | HASH_COMPARE);
-  MemSet(&ctl, 0, sizeof(ctl));
   ctl.keysize = sizeof(Oid);
   ctl.entrysize = sizeof(relnameCacheEntry);
   ctl.hash = oid_hash;
@@ -296,6 +1346,8 @@ void _PG_fini(void) {
   shmem_startup_hook = prev_shmem_startup_hook;
   ExecutorCheckPerms_hook = prev_check_perms_hook;
   ProcessUtility_hook = next_ProcessUtility_hook;
+  ExecutorRun_hook = prev_ExecutorRun_hook;
+  ExecutorFinish_hook = prev_ExecutorFinish_hook;
   ExecutorEnd_hook = prev_ExecutorEnd_hook;
   object_access_hook = prev_object_access_hook;
 }
@@ -306,8 +1358,21 @@ static bool collect_relaccess_hook(List *rangeTable,
       !prev_check_perms_hook(rangeTable, ereport_on_violation)) {
     return false;
   }
-  if (Gp_role == GP_ROLE_DISPATCH && is_enabled) {
+  if (Gp_role == GP_ROLE_DISPATCH && is_enabled && !skip_nested_access() &&
+      !is_session_excluded()) {
     ListCell *l;
+    instr_time start, duration;
+    INSTR_TIME_SET_CURRENT(start);
+    LOCAL_STAT_ADD(hook_calls, 1);
+    // all relations of a query share the timestamp
+    TimestampTz curts = GetCurrentTimestamp();
+    /**
+     * The rewriter moves the permission check of a view down to the view's own
+     * range table, followed by the tables it references, which are checked as
+     * the view owner. The planner keeps such range tables contiguous, so a
+     * relation checked as another user belongs to the closest view before it.
+     */
+    Oid current_view = InvalidOid;
     foreach (l, rangeTable) {
       RangeTblEntry *rte = (RangeTblEntry *)lfirst(l);
       if (rte->rtekind != RTE_RELATION) {
@@ -315,459 +1380,3532 @@ static bool collect_relaccess_hook(List *rangeTable,
       }
       Oid relid = rte->relid;
       AclMode requiredPerms = rte->requiredPerms;
-      if (is_read(requiredPerms) || is_write(requiredPerms)) {
-        memorize_local_access_entry(relid, requiredPerms);
-        update_relname_cache(relid, NULL);
+      if (!is_read(requiredPerms) && !is_write(requiredPerms)) {
+        continue;
+      }
+      bool tracked = track_relation(&relid);
+      if (rte->relkind == RELKIND_VIEW) {
+        // temp views are not worth linking
+        current_view = tracked && relid == rte->relid ? relid : InvalidOid;
+      }
+      if (tracked) {
+        localAccessEntry *entry =
+            memorize_local_access_entry(relid, requiredPerms, curts, true);
+        if (rte->relkind != RELKIND_VIEW && OidIsValid(rte->checkAsUser) &&
+            OidIsValid(current_view) && relaccess_view_links) {
+          entry->viewid = current_view;
+        }
       }
     }
+    INSTR_TIME_SET_CURRENT(duration);
+    INSTR_TIME_SUBTRACT(duration, start);
+    record_latency(LATENCY_COLLECT_HOOK, duration);
   }
   return true;
 }
 
-static void collect_truncate_hook(Node *parsetree, const char *queryString,
-                                  ProcessUtilityContext context,
-                                  ParamListInfo params, DestReceiver *dest,
-                                  char *completionTag) {
-  if (nodeTag(parsetree) == T_TruncateStmt && is_enabled &&
-      Gp_role == GP_ROLE_DISPATCH) {
-    TruncateStmt *stmt = (TruncateStmt *)parsetree;
-    ListCell *cell;
-    /**
-     *  TODO: TRUNCATE may be called with ONLY option which limits it only to
-     *the root partition. Otherwise it will truncate all child partitions. We
-     *might wish to track the difference by explicitly adding records for each
-     *truncated partition in the future if it proves useful
-     **/
-    foreach (cell, stmt->relations) {
-      RangeVar *rv = lfirst(cell);
-      Relation rel;
-      rel = heap_openrv(rv, AccessExclusiveLock);
-      Oid relid = rel->rd_id;
-      heap_close(rel, NoLock);
-      memorize_local_access_entry(relid, ACL_TRUNCATE);
-      update_relname_cache(relid, rv->relname);
-    }
-  }
-  if (next_ProcessUtility_hook) {
-    next_ProcessUtility_hook(parsetree, queryString, context, params, dest,
-                             completionTag);
-  } else {
-    standard_ProcessUtility(parsetree, queryString, context, params, dest,
-                            completionTag);
+static bool check_exclude_roles(char **newval, void **extra,
+                                GucSource source) {
+  char *rawstring = pstrdup(*newval);
+  List *names;
+  bool ok = SplitIdentifierString(rawstring, ',', &names);
+  if (!ok) {
+    GUC_check_errdetail("List syntax is invalid.");
   }
+  list_free(names);
+  pfree(rawstring);
+  return ok;
 }
 
-#define UPDATE_STAT(lowercase, uppercase)                                      \
-  dst_entry->n_##lowercase += (src_entry->perms & ACL_##uppercase ? 1 : 0)
-
-// if there is a better way to cleanup a postgres hashtable
-// w/o recreating it, I didn't find it
-#define CLEAR_HTAB(entryType, hmap, key_name)                                  \
-  {                                                                            \
-    HASH_SEQ_STATUS hash_seq;                                                  \
-    entryType *src_entry;                                                      \
-    hash_seq_init(&hash_seq, hmap);                                            \
-    while ((src_entry = hash_seq_search(&hash_seq)) != NULL) {                 \
-      bool found;                                                              \
-      hash_search(hmap, &src_entry->key_name, HASH_REMOVE, &found);            \
-      Assert(found);                                                           \
-    }                                                                          \
-  }
+static void invalidate_session_exclusion(const char *newval, void *extra) {
+  session_excluded_valid = false;
+}
 
-static void relaccess_xact_callback(XactEvent event, void *arg) {
-  if (Gp_role != GP_ROLE_DISPATCH || !is_enabled) {
-    return;
-  }
-  // TODO: add support for savepoint rollbacks
-  Assert(GetCurrentTransactionNestLevel() == 1);
-  if (event == XACT_EVENT_COMMIT) {
-    HASH_SEQ_STATUS hash_seq;
-    localAccessEntry *src_entry;
-    hash_seq_init(&hash_seq, local_access_entries);
-    LWLockAcquire(data->relaccess_ht_lock, LW_EXCLUSIVE);
-    while ((src_entry = hash_seq_search(&hash_seq)) != NULL) {
-      bool found;
-      relaccessHashKey key;
-      key.dbid = MyDatabaseId;
-      key.relid = src_entry->key.relid;
-      long n_access_records = hash_get_num_entries(relaccesses);
-      relaccessEntry *dst_entry = NULL;
-      Assert(n_access_records <= relaccess_size);
-      if (n_access_records == relaccess_size) {
-        // no room for new entries. Perhaps this relid is already being tracked?
-        dst_entry =
-            (relaccessEntry *)hash_search(relaccesses, &key, HASH_FIND, &found);
-      } else {
-        dst_entry = (relaccessEntry *)hash_search(relaccesses, &key,
-                                                  HASH_ENTER_NULL, &found);
-      }
-      if (dst_entry || dump_on_overflow) {
-        if (!dst_entry) {
-          // we are out of shared memory and need to dump
-          relaccess_dump_to_files(false);
-          // we MUST have enough space now, unless we were unable to dump
-          dst_entry = (relaccessEntry *)hash_search(relaccesses, &key,
-                                                    HASH_ENTER_NULL, &found);
-          if (!dst_entry) {
-            // still no memory left
-            if (!had_ht_overflow) {
-              elog(WARNING, ("gp_relaccess_stats.max_tables is exceeded and we "
-                             "are unable to dump hashtables to disk. "
-                             "Will start loosing some relaccess stats"));
-              had_ht_overflow = true;
-            }
-            continue;
-          } else {
-            had_ht_overflow = false;
-          }
-        }
-        if (!found) {
-          dst_entry->last_reader_id = InvalidOid;
-          dst_entry->last_writer_id = InvalidOid;
-          dst_entry->last_read = 0;
-          dst_entry->last_write = 0;
-          dst_entry->n_select = 0;
-          dst_entry->n_insert = 0;
-          dst_entry->n_update = 0;
-          dst_entry->n_delete = 0;
-          dst_entry->n_truncate = 0;
-        }
-        UPDATE_STAT(select, SELECT);
-        UPDATE_STAT(insert, INSERT);
-        UPDATE_STAT(update, UPDATE);
-        UPDATE_STAT(delete, DELETE);
-        UPDATE_STAT(truncate, TRUNCATE);
-        if (src_entry->last_read > dst_entry->last_read) {
-          dst_entry->last_read = src_entry->last_read;
-          dst_entry->last_reader_id = src_entry->last_reader_id;
+// pattern may contain * matching any sequence of characters
+static bool match_pattern(const char *pattern, const char *str) {
+  for (; *pattern != '\0'; pattern++, str++) {
+    if (*pattern == '*') {
+      for (; *str != '\0'; str++) {
+        if (match_pattern(pattern + 1, str)) {
+          return true;
         }
-        if (src_entry->last_write > dst_entry->last_write) {
-          dst_entry->last_write = src_entry->last_write;
-          dst_entry->last_writer_id = src_entry->last_writer_id;
-        }
-        relnameCacheEntry *namecache_entry = (relnameCacheEntry *)hash_search(
-            relname_cache, &key.relid, HASH_ENTER, &found);
-        Assert(namecache_entry);
-        strlcpy(dst_entry->relname, namecache_entry->relname,
-                sizeof(dst_entry->relname));
-      } else {
-        if (!had_ht_overflow) {
-          elog(WARNING, "gp_relaccess_stats.max_tables is exceeded! New table "
-                        "events will be lost. "
-                        "Please execute relaccess_stats_update() and consider "
-                        "setting a hihger value");
-        }
-        had_ht_overflow = true;
       }
+      return match_pattern(pattern + 1, str);
+    }
+    if (*pattern != *str) {
+      return false;
     }
-    LWLockRelease(data->relaccess_ht_lock);
-    CLEAR_HTAB(localAccessEntry, local_access_entries, key);
-    CLEAR_HTAB(relnameCacheEntry, relname_cache, relid);
-  } else if (event == XACT_EVENT_ABORT) {
-    CLEAR_HTAB(localAccessEntry, local_access_entries, key);
-    CLEAR_HTAB(relnameCacheEntry, relname_cache, relid);
   }
+  return *str == '\0';
 }
 
-Datum relaccess_stats_update(PG_FUNCTION_ARGS) {
-  relaccess_stats_update_internal();
-  PG_RETURN_VOID();
+static bool is_role_excluded(Oid roleid) {
+  char *rawstring;
+  List *names;
+  ListCell *l;
+  bool excluded = false;
+  if (exclude_roles == NULL || exclude_roles[0] == '\0') {
+    return false;
+  }
+  rawstring = pstrdup(exclude_roles);
+  if (SplitIdentifierString(rawstring, ',', &names)) {
+    foreach (l, names) {
+      if (get_role_oid(lfirst(l), true) == roleid) {
+        excluded = true;
+        break;
+      }
+    }
+  }
+  list_free(names);
+  pfree(rawstring);
+  return excluded;
 }
 
-Datum relaccess_stats_dump(PG_FUNCTION_ARGS) {
-  LWLockAcquire(data->relaccess_ht_lock, LW_EXCLUSIVE);
-  relaccess_dump_to_files(true);
-  LWLockRelease(data->relaccess_ht_lock);
-  PG_RETURN_VOID();
+static bool is_application_excluded(const char *appname) {
+  char *rawstring;
+  char *pattern;
+  char *next;
+  bool excluded = false;
+  if (exclude_applications == NULL || exclude_applications[0] == '\0') {
+    return false;
+  }
+  rawstring = pstrdup(exclude_applications);
+  for (pattern = rawstring; pattern != NULL && !excluded; pattern = next) {
+    char *end;
+    next = strchr(pattern, ',');
+    if (next != NULL) {
+      *next++ = '\0';
+    }
+    while (isspace((unsigned char)*pattern)) {
+      pattern++;
+    }
+    end = pattern + strlen(pattern);
+    while (end > pattern && isspace((unsigned char)end[-1])) {
+      *--end = '\0';
+    }
+    excluded = *pattern != '\0' && match_pattern(pattern, appname);
+  }
+  pfree(rawstring);
+  return excluded;
 }
 
-Datum relaccess_stats_fillfactor(PG_FUNCTION_ARGS) {
-  LWLockAcquire(data->relaccess_ht_lock, LW_SHARED);
-  int16_t fillfactor = hash_get_num_entries(relaccesses) * 100 / relaccess_size;
-  LWLockRelease(data->relaccess_ht_lock);
-  PG_RETURN_INT16(fillfactor);
+/**
+ * Exclusion lists are resolved once and cached until either list, the session
+ * user or application_name changes, so that statements of both excluded and
+ * tracked sessions don't pay for it. Must be called inside a transaction.
+ */
+static bool is_session_excluded(void) {
+  Oid userid = GetSessionUserId();
+  const char *appname = application_name ? application_name : "";
+  if (session_excluded_valid && session_excluded_user == userid &&
+      (exclude_applications == NULL || exclude_applications[0] == '\0' ||
+       strcmp(session_excluded_app, appname) == 0)) {
+    return session_excluded;
+  }
+  session_excluded =
+      is_role_excluded(userid) || is_application_excluded(appname);
+  session_excluded_user = userid;
+  strlcpy(session_excluded_app, appname, sizeof(session_excluded_app));
+  session_excluded_valid = true;
+  return session_excluded;
 }
 
-Datum relaccess_stats_from_dump(PG_FUNCTION_ARGS) {
-  FuncCallContext *funcctx;
-  List *stats_entries = NIL;
+#define MAX_DDL_TARGETS 2
 
-  if (SRF_IS_FIRSTCALL()) {
-    funcctx = SRF_FIRSTCALL_INIT();
-    MemoryContext oldcontext =
-        MemoryContextSwitchTo(funcctx->multi_call_memory_ctx);
-    TupleDesc tupdesc = CreateTemplateTupleDesc(11, false /* hasoid */);
-    TupleDescInitEntry(tupdesc, (AttrNumber)1, "relid", OIDOID, -1 /* typmod */,
-                       0 /* attdim */);
-    TupleDescInitEntry(tupdesc, (AttrNumber)2, "relname", NAMEOID,
-                       -1 /* typmod */, 0 /* attdim */);
-    TupleDescInitEntry(tupdesc, (AttrNumber)3, "last_reader_id", OIDOID,
-                       -1 /* typmod */, 0 /* attdim */);
-    TupleDescInitEntry(tupdesc, (AttrNumber)4, "last_writer_id", OIDOID,
-                       -1 /* typmod */, 0 /* attdim */);
-    TupleDescInitEntry(tupdesc, (AttrNumber)5, "last_read", TIMESTAMPTZOID,
-                       -1 /* typmod */, 0 /* attdim */);
-    TupleDescInitEntry(tupdesc, (AttrNumber)6, "last_write", TIMESTAMPTZOID,
-                       -1 /* typmod */, 0 /* attdim */);
-    TupleDescInitEntry(tupdesc, (AttrNumber)7, "n_select_queries", INT4OID,
-                       -1 /* typmod */, 0 /* attdim */);
-    TupleDescInitEntry(tupdesc, (AttrNumber)8, "n_insert_queries", INT4OID,
-                       -1 /* typmod */, 0 /* attdim */);
-    TupleDescInitEntry(tupdesc, (AttrNumber)9, "n_update_queries", INT4OID,
-                       -1 /* typmod */, 0 /* attdim */);
-    TupleDescInitEntry(tupdesc, (AttrNumber)10, "n_delete_queries", INT4OID,
-                       -1 /* typmod */, 0 /* attdim */);
-    TupleDescInitEntry(tupdesc, (AttrNumber)11, "n_truncate_queries", INT4OID,
-                       -1 /* typmod */, 0 /* attdim */);
-    funcctx->tuple_desc = BlessTupleDesc(tupdesc);
-    StringInfoData dump_file = get_dump_filename(MyDatabaseId);
-    FILE *dump = AllocateFile(dump_file.data, "rb");
-    pfree(dump_file.data);
-    if (dump) {
-      while (true) {
-        relaccessEntry *entry = palloc(sizeof(relaccessEntry));
-        if (fread(entry, sizeof(relaccessEntry), 1, dump) != 1) {
-          pfree(entry);
-          break;
+/**
+ * Fills targets with tables affected by a DDL statement we track and returns
+ * their number, which is 0 for any other statement
+ */
+static int get_ddl_targets(Node *parsetree, Oid *targets) {
+  RangeVar *rv = NULL;
+  int n_targets = 0;
+  switch (nodeTag(parsetree)) {
+  case T_AlterTableStmt: {
+    AlterTableStmt *stmt = (AlterTableStmt *)parsetree;
+    ListCell *cell;
+    rv = stmt->relation;
+    // EXCHANGE PARTITION also changes the table a partition is exchanged with
+    foreach (cell, stmt->cmds) {
+      AlterTableCmd *cmd = (AlterTableCmd *)lfirst(cell);
+      if (cmd->subtype == AT_PartExchange && cmd->def &&
+          IsA(cmd->def, AlterPartitionCmd)) {
+        AlterPartitionCmd *pc = (AlterPartitionCmd *)cmd->def;
+        if (pc->arg1 && IsA(pc->arg1, RangeVar)) {
+          Oid relid = RangeVarGetRelid((RangeVar *)pc->arg1, NoLock, true);
+          if (OidIsValid(relid)) {
+            targets[n_targets++] = relid;
+          }
         }
-        stats_entries = lappend(stats_entries, entry);
+        break;
       }
-      FreeFile(dump);
     }
-    funcctx->user_fctx = stats_entries;
-    MemoryContextSwitchTo(oldcontext);
+    break;
   }
-
-  funcctx = SRF_PERCALL_SETUP();
-  stats_entries = (List *)funcctx->user_fctx;
-
-  while (true) {
-    if (stats_entries == NIL) {
-      SRF_RETURN_DONE(funcctx);
+  case T_IndexStmt:
+    rv = ((IndexStmt *)parsetree)->relation;
+    break;
+  case T_ReindexStmt: {
+    ReindexStmt *stmt = (ReindexStmt *)parsetree;
+    if (stmt->kind == OBJECT_INDEX && stmt->relation) {
+      Oid indexid = RangeVarGetRelid(stmt->relation, NoLock, true);
+      Oid relid =
+          OidIsValid(indexid) ? IndexGetRelation(indexid, true) : InvalidOid;
+      if (OidIsValid(relid)) {
+        targets[n_targets++] = relid;
+      }
+    } else if (stmt->kind == OBJECT_TABLE) {
+      rv = stmt->relation;
     }
-    relaccessEntry *entry = linitial(stats_entries);
-    stats_entries = list_delete_first(stats_entries);
-    Datum values[11];
-    bool nulls[11];
-    MemSet(nulls, 0, sizeof(nulls));
-    values[0] = ObjectIdGetDatum(entry->key.relid);
-    values[1] = CStringGetDatum(entry->relname);
-    values[2] = ObjectIdGetDatum(entry->last_reader_id);
-    values[3] = ObjectIdGetDatum(entry->last_writer_id);
-    values[4] = TimestampTzGetDatum(entry->last_read);
-    values[5] = TimestampTzGetDatum(entry->last_write);
-    values[6] = Int32GetDatum(entry->n_select);
-    values[7] = Int32GetDatum(entry->n_insert);
-    values[8] = Int32GetDatum(entry->n_update);
-    values[9] = Int32GetDatum(entry->n_delete);
-    values[10] = Int32GetDatum(entry->n_truncate);
-    HeapTuple tuple = heap_form_tuple(funcctx->tuple_desc, values, nulls);
-    Datum result = HeapTupleGetDatum(tuple);
-    funcctx->user_fctx = stats_entries;
-    /** NOTE: Cannot delete entry from this iteration right now.
-     * For now let's rely on multi_call_memory_ctx until there is a proven
-     * memory problem with this codepath
-     */
-    // pfree(entry);
-    SRF_RETURN_NEXT(funcctx, result);
+    break;
+  }
+  case T_ClusterStmt:
+    rv = ((ClusterStmt *)parsetree)->relation;
+    break;
+  case T_VacuumStmt: {
+    VacuumStmt *stmt = (VacuumStmt *)parsetree;
+    if (stmt->options & VACOPT_FULL) {
+      rv = stmt->relation;
+    }
+    break;
+  }
+  default:
+    break;
   }
+  if (rv) {
+    Oid relid = RangeVarGetRelid(rv, NoLock, true);
+    if (OidIsValid(relid)) {
+      targets[n_targets++] = relid;
+    }
+  }
+  Assert(n_targets <= MAX_DDL_TARGETS);
+  return n_targets;
 }
 
-static void relaccess_stats_update_internal() {
-  LWLockAcquire(data->relaccess_ht_lock, LW_EXCLUSIVE);
-  relaccess_dump_to_files(true);
-  LWLockRelease(data->relaccess_ht_lock);
-  relaccess_upsert_from_file();
+static Oid get_relfilenode(Oid relid) {
+  Oid relfilenode = InvalidOid;
+  HeapTuple tp = SearchSysCache1(RELOID, ObjectIdGetDatum(relid));
+  if (HeapTupleIsValid(tp)) {
+    relfilenode = ((Form_pg_class)GETSTRUCT(tp))->relfilenode;
+    ReleaseSysCache(tp);
+  }
+  return relfilenode;
 }
 
-static void add_file_dump_entry(Oid dbid, HTAB *ht) {
-  bool found;
-  fileDumpEntry *file_entry = hash_search(ht, &dbid, HASH_ENTER, &found);
-  if (!found) {
-    file_entry->dbid = dbid;
-    StringInfoData filename = get_dump_filename(file_entry->dbid);
-    file_entry->filename = filename.data;
-    file_entry->file = AllocateFile(file_entry->filename, "ab");
+// relfilenode of a table or an index before a database-wide statement
+typedef struct relfilenodeSnapshot {
+  Oid relid;
+  Oid relfilenode;
+  char relkind;
+} relfilenodeSnapshot;
+
+/**
+ * VACUUM FULL and CLUSTER w/o a table, REINDEX DATABASE and REINDEX SYSTEM
+ * process the whole database, one transaction per relation.
+ */
+static bool is_database_wide_rebuild(Node *parsetree) {
+  switch (nodeTag(parsetree)) {
+  case T_VacuumStmt:
+    return (((VacuumStmt *)parsetree)->options & VACOPT_FULL) &&
+           ((VacuumStmt *)parsetree)->relation == NULL;
+  case T_ClusterStmt:
+    return ((ClusterStmt *)parsetree)->relation == NULL;
+  case T_ReindexStmt:
+    return ((ReindexStmt *)parsetree)->kind == OBJECT_DATABASE;
+  default:
+    return false;
   }
 }
 
-static void relaccess_dump_to_files(bool only_this_db) {
-  HTAB *file_mapping;
-  HASHCTL ctl;
-  MemSet(&ctl, 0, sizeof(ctl));
-  ctl.keysize = sizeof(Oid);
-  ctl.entrysize = sizeof(fileDumpEntry);
-  ctl.hash = oid_hash;
-  file_mapping = hash_create("Relaccess dump files", FILE_CACHE_SZ, &ctl,
-                             HASH_ELEM | HASH_FUNCTION);
-  LWLockAcquire(data->relaccess_file_lock, LW_EXCLUSIVE);
-  if (only_this_db) {
-    add_file_dump_entry(MyDatabaseId, file_mapping);
-  } else {
-    HASH_SEQ_STATUS hash_seq;
-    relaccessEntry *access_entry;
-    hash_seq_init(&hash_seq, relaccesses);
-    while ((access_entry = hash_seq_search(&hash_seq)) != NULL) {
-      add_file_dump_entry(access_entry->key.dbid, file_mapping);
+/**
+ * Database-wide statements name no relations, so we remember relfilenodes of
+ * all tables and indexes before the statement and compare them afterwards to
+ * tell what it has rebuilt. Such statements commit on their own, so the
+ * snapshot is allocated in the caller's context, which outlives them.
+ */
+static relfilenodeSnapshot *snapshot_relfilenodes(int *n) {
+  int capacity = 1024;
+  relfilenodeSnapshot *snapshot =
+      palloc(sizeof(relfilenodeSnapshot) * capacity);
+  Relation rel = heap_open(RelationRelationId, AccessShareLock);
+  HeapScanDesc scan = heap_beginscan_catalog(rel, 0, NULL);
+  HeapTuple tuple;
+  *n = 0;
+  while ((tuple = heap_getnext(scan, ForwardScanDirection)) != NULL) {
+    Form_pg_class reltup = (Form_pg_class)GETSTRUCT(tuple);
+    if (reltup->relkind != RELKIND_RELATION &&
+        reltup->relkind != RELKIND_MATVIEW &&
+        reltup->relkind != RELKIND_INDEX) {
+      continue;
     }
+    if (*n == capacity) {
+      capacity *= 2;
+      snapshot = repalloc(snapshot, sizeof(relfilenodeSnapshot) * capacity);
+    }
+    snapshot[*n].relid = HeapTupleGetOid(tuple);
+    snapshot[*n].relfilenode = reltup->relfilenode;
+    snapshot[*n].relkind = reltup->relkind;
+    (*n)++;
   }
-  relaccess_dump_to_files_internal(file_mapping);
-  HASH_SEQ_STATUS hash_seq;
-  hash_seq_init(&hash_seq, file_mapping);
-  fileDumpEntry *entry;
-  while ((entry = hash_seq_search(&hash_seq)) != NULL) {
-    FreeFile(entry->file);
-    pfree(entry->filename);
-  }
-  LWLockRelease(data->relaccess_file_lock);
-  hash_destroy(file_mapping);
+  heap_endscan(scan);
+  heap_close(rel, AccessShareLock);
+  return snapshot;
 }
 
-static void relaccess_dump_to_files_internal(HTAB *files) {
-  HASH_SEQ_STATUS hash_seq;
-  relaccessEntry *entry;
-  hash_seq_init(&hash_seq, relaccesses);
-  while ((entry = hash_seq_search(&hash_seq)) != NULL) {
-    bool found;
-    fileDumpEntry *dumpfile =
-        hash_search(files, &entry->key.dbid, HASH_FIND, &found);
-    if (!found) {
-      // we don't want to dump events from this DB
+/**
+ * Rebuilt tables are recorded as rewritten by a DDL statement and tables of
+ * rebuilt indexes as altered by one, same as if the statement named them.
+ */
+static void record_rebuilt_relations(relfilenodeSnapshot *snapshot, int n) {
+  TimestampTz curts = GetCurrentTimestamp();
+  int i;
+  LOCAL_STAT_ADD(hook_calls, 1);
+  for (i = 0; i < n; i++) {
+    Oid relid = snapshot[i].relid;
+    Oid relfilenode = get_relfilenode(relid);
+    AclMode perms = RELACCESS_DDL | RELACCESS_REWRITE;
+    if (!OidIsValid(relfilenode) || relfilenode == snapshot[i].relfilenode) {
       continue;
     }
-    if (fwrite(entry, sizeof(relaccessEntry), 1, dumpfile->file) != 1) {
-      hash_seq_term(&hash_seq);
-      ereport(WARNING,
-              (errcode_for_file_access(),
-               errmsg("could not write gp_relaccess_stats file \"%s\": %m",
-                      dumpfile->filename)));
-      break;
+    if (snapshot[i].relkind == RELKIND_INDEX) {
+      relid = IndexGetRelation(relid, true);
+      perms = RELACCESS_DDL;
+    }
+    if (OidIsValid(relid) && track_relation(&relid)) {
+      memorize_local_access_entry(relid, perms, curts, true);
     }
-    hash_search(relaccesses, &entry->key, HASH_REMOVE, &found);
-    had_ht_overflow = false;
   }
 }
 
-static void relaccess_upsert_from_file() {
-  int ret;
-  if ((ret = SPI_connect()) < 0) {
-    elog(ERROR, "SPI connect failure - returned %d", ret);
+static void collect_utility_hook(Node *parsetree, const char *queryString,
+                                 ProcessUtilityContext context,
+                                 ParamListInfo params, DestReceiver *dest,
+                                 char *completionTag) {
+  Oid ddl_targets[MAX_DDL_TARGETS];
+  Oid relfilenodes[MAX_DDL_TARGETS];
+  int n_ddl_targets = 0;
+  relfilenodeSnapshot *rebuild_snapshot = NULL;
+  int n_rebuild_snapshot = 0;
+  int i;
+  // statements of a DO block are nested, unlike ones of CREATE TABLE AS, COPY
+  // or EXPLAIN ANALYZE, which are executed right by ProcessUtility
+  bool is_do_block = nodeTag(parsetree) == T_DoStmt;
+  bool track = is_enabled && Gp_role == GP_ROLE_DISPATCH &&
+               !skip_nested_access() && !is_session_excluded();
+  Oid refresh_relid = InvalidOid;
+  int prev_refresh_level = refresh_nesting_level;
+  instr_time refresh_start;
+  relaccess_dump_if_requested();
+  if (track) {
+    // relations are resolved w/o locking, the statement itself will lock them
+    n_ddl_targets = get_ddl_targets(parsetree, ddl_targets);
+    for (i = 0; i < n_ddl_targets; i++) {
+      relfilenodes[i] = get_relfilenode(ddl_targets[i]);
+    }
+    if (is_database_wide_rebuild(parsetree)) {
+      rebuild_snapshot = snapshot_relfilenodes(&n_rebuild_snapshot);
+    }
+    if (nodeTag(parsetree) == T_RefreshMatViewStmt) {
+      refresh_relid = RangeVarGetRelid(
+          ((RefreshMatViewStmt *)parsetree)->relation, NoLock, true);
+    }
   }
-  LWLockAcquire(data->relaccess_file_lock, LW_EXCLUSIVE);
-  StringInfoData filename = get_dump_filename(MyDatabaseId);
-  StringInfoData query;
-  initStringInfo(&query);
-  appendStringInfo(&query,
-                   "SELECT relaccess.__relaccess_upsert_from_dump_file()");
-  ret = SPI_execute(query.data, false, 1);
-  unlink(filename.data);
-  LWLockRelease(data->relaccess_file_lock);
-  SPI_finish();
-  if (ret < 0) {
-    elog(ERROR, "SPI execute failure - returned %d", ret);
+  if (OidIsValid(refresh_relid)) {
+    // the query filling the matview ends at our own nesting level
+    refresh_nesting_level = nesting_level;
+    refresh_processed = 0;
+    INSTR_TIME_SET_CURRENT(refresh_start);
   }
-}
-
-static void update_relname_cache(Oid relid, char *relname) {
-  bool found;
-  relnameCacheEntry *relname_entry = (relnameCacheEntry *)hash_search(
-      relname_cache, &relid, HASH_ENTER, &found);
-  if (!found) {
-    relname_entry->relid = relid;
-    if (!relname) {
-      strlcpy(relname_entry->relname, get_rel_name(relid),
-              sizeof(relname_entry->relname));
+  if (is_do_block) {
+    nesting_level++;
+  }
+  PG_TRY();
+  {
+    if (next_ProcessUtility_hook) {
+      next_ProcessUtility_hook(parsetree, queryString, context, params, dest,
+                               completionTag);
     } else {
-      strlcpy(relname_entry->relname, relname, sizeof(relname_entry->relname));
+      standard_ProcessUtility(parsetree, queryString, context, params, dest,
+                              completionTag);
     }
-  } else {
-    /**
-     * NOTE: as we don't handle the 'else' clause here, there will be cases when
-     * we write outdated table names, like below:
-     *    BEGIN;
-     *      INSERT INTO tbl VALUES (1);
-     *      ALTER TABLE tbl RENAME TO new_tbl;
-     *      SELECT * FROM new_tbl;
-     *    COMMIT;
-     * In this case both INSERT and SELECT stmts would be counted with the
-     * old'tbl' name, as we don't update our cache for already known relids in
-     * the same transaction. This is a deliberate decision for performance
-     * reasons.
-     */
+  }
+  PG_CATCH();
+  {
+    if (is_do_block) {
+      nesting_level--;
+    }
+    refresh_nesting_level = prev_refresh_level;
+    PG_RE_THROW();
+  }
+  PG_END_TRY();
+  if (is_do_block) {
+    nesting_level--;
+  }
+  refresh_nesting_level = prev_refresh_level;
+  if (OidIsValid(refresh_relid) && track_relation(&refresh_relid)) {
+    instr_time duration;
+    INSTR_TIME_SET_CURRENT(duration);
+    INSTR_TIME_SUBTRACT(duration, refresh_start);
+    LOCAL_STAT_ADD(hook_calls, 1);
+    memorize_local_access_entry(refresh_relid, RELACCESS_REFRESH,
+                                GetCurrentTimestamp(), true);
+    remember_refresh(refresh_relid, INSTR_TIME_GET_MILLISEC(duration),
+                     refresh_processed);
+  }
+  if (rebuild_snapshot) {
+    record_rebuilt_relations(rebuild_snapshot, n_rebuild_snapshot);
+    pfree(rebuild_snapshot);
+  }
+  if (n_ddl_targets > 0) {
+    TimestampTz curts = GetCurrentTimestamp();
+    LOCAL_STAT_ADD(hook_calls, 1);
+    for (i = 0; i < n_ddl_targets; i++) {
+      Oid relid = ddl_targets[i];
+      Oid relfilenode = get_relfilenode(relid);
+      AclMode perms = RELACCESS_DDL;
+      if (OidIsValid(relfilenodes[i]) && OidIsValid(relfilenode) &&
+          relfilenode != relfilenodes[i]) {
+        perms |= RELACCESS_REWRITE;
+      }
+      // the table could be dropped or renamed by the statement
+      if (track_relation(&relid)) {
+        memorize_local_access_entry(relid, perms, curts, true);
+      }
+    }
+  }
+  /**
+   * We record truncates after they succeed, when relations are already locked
+   * by TRUNCATE itself, so there is no need to lock them one more time.
+   * Unless ONLY is specified, all inheritors are truncated as well. Those are
+   * not counted as separate queries, but get their last_write updated.
+   */
+  if (nodeTag(parsetree) == T_TruncateStmt && track) {
+    TruncateStmt *stmt = (TruncateStmt *)parsetree;
+    ListCell *cell;
+    TimestampTz curts = GetCurrentTimestamp();
+    LOCAL_STAT_ADD(hook_calls, 1);
+    foreach (cell, stmt->relations) {
+      RangeVar *rv = lfirst(cell);
+      Oid relid = RangeVarGetRelid(rv, NoLock, true);
+      Oid tracked_relid = relid;
+      if (!OidIsValid(relid)) {
+        continue;
+      }
+      if (track_relation(&tracked_relid)) {
+        memorize_local_access_entry(tracked_relid, ACL_TRUNCATE, curts, true);
+      }
+      if (interpretInhOption(rv->inhOpt)) {
+        inheritanceCacheEntry *inh = get_inheritors(relid);
+        for (i = 0; i < inh->n_inheritors; i++) {
+          // cached inheritors might have been dropped since
+          tracked_relid = inh->inheritors[i];
+          if (track_relation(&tracked_relid)) {
+            memorize_local_access_entry(tracked_relid, ACL_TRUNCATE, curts,
+                                        false);
+          }
+        }
+      }
+    }
+  }
+  if (nesting_level == 0) {
+    remember_statement_end();
   }
 }
 
-static void memorize_local_access_entry(Oid relid, AclMode perms) {
+/**
+ * Returns all inheritors of relid, excluding relid itself. The cache is thrown
+ * away whenever pg_inherits changes in any backend, be it a relation joining a
+ * hierarchy or leaving it with ALTER TABLE ... NO INHERIT. Relcache
+ * invalidations are of no use here, as TRUNCATE itself sends them for all the
+ * relations involved. Dropped inheritors are skipped by the caller.
+ */
+static inheritanceCacheEntry *get_inheritors(Oid relid) {
   bool found;
-  localAccessKey key;
-  key.stmt_cnt = stmt_counter;
-  key.relid = relid;
-  localAccessEntry *entry = (localAccessEntry *)hash_search(
-      local_access_entries, &key, HASH_ENTER, &found);
-  if (!found) {
-    entry->last_read = entry->last_write = InvalidOid;
-    entry->perms = perms;
-    entry->last_read = 0;
-    entry->last_write = 0;
-  } else {
-    entry->perms |= perms;
+  if (!inheritance_cache_valid) {
+    if (inheritance_cache_context == NULL) {
+      inheritance_cache_context = AllocSetContextCreate(
+          CacheMemoryContext, "relaccess inheritance cache",
+          ALLOCSET_DEFAULT_MINSIZE, ALLOCSET_DEFAULT_INITSIZE,
+          ALLOCSET_DEFAULT_MAXSIZE);
+    } else {
+      MemoryContextReset(inheritance_cache_context);
+    }
+    HASHCTL ctl;
+    MemSet(&ctl, 0, sizeof(ctl));
+    ctl.keysize = sizeof(Oid);
+    ctl.entrysize = sizeof(inheritanceCacheEntry);
+    ctl.hash = oid_hash;
+    ctl.hcxt = inheritance_cache_context;
+    inheritance_cache =
+        hash_create("Relaccess inheritance cache", INHCACHE_SZ, &ctl,
+                    HASH_ELEM | HASH_FUNCTION | HASH_CONTEXT);
+    inheritance_cache_valid = true;
   }
-  TimestampTz curts = GetCurrentTimestamp();
-  if (is_read(perms)) {
-    entry->last_reader_id = GetUserId();
-    entry->last_read = curts;
+  inheritanceCacheEntry *entry = (inheritanceCacheEntry *)hash_search(
+      inheritance_cache, &relid, HASH_FIND, &found);
+  if (found) {
+    return entry;
   }
-  if (is_write(perms)) {
-    entry->last_writer_id = GetUserId();
-    entry->last_write = curts;
+  // relations are locked by the caller
+  List *inheritors = find_all_inheritors(relid, NoLock, NULL);
+  Oid *inheritor_oids = MemoryContextAlloc(
+      inheritance_cache_context, sizeof(Oid) * list_length(inheritors));
+  int n_inheritors = 0;
+  ListCell *cell;
+  foreach (cell, inheritors) {
+    Oid inheritor = lfirst_oid(cell);
+    if (inheritor != relid) {
+      inheritor_oids[n_inheritors++] = inheritor;
+    }
   }
+  list_free(inheritors);
+  entry = (inheritanceCacheEntry *)hash_search(inheritance_cache, &relid,
+                                               HASH_ENTER, &found);
+  entry->n_inheritors = n_inheritors;
+  entry->inheritors = inheritor_oids;
+  return entry;
 }
 
-static void relaccess_executor_end_hook(QueryDesc *query_desc) {
-  if (prev_ExecutorEnd_hook) {
-    prev_ExecutorEnd_hook(query_desc);
-  } else {
-    standard_ExecutorEnd(query_desc);
-  }
-  // Unfortunately, we cannot safely rely on gp_command_counter as
-  // it is being incremented more than once for many statements.
-  // So we have to maintain our own statement counter.
-  stmt_counter++;
+static void relaccess_inherits_callback(Datum arg, int cacheid,
+                                        uint32 hashvalue) {
+  inheritance_cache_valid = false;
 }
 
-static StringInfoData get_dump_filename(Oid dbid) {
-  StringInfoData filename;
+#define UPDATE_STAT(lowercase) dst_entry->n_##lowercase += src_entry->n_##lowercase
+
+#define COUNT_STAT(lowercase, uppercase)                                       \
+  dst->n_##lowercase += (perms & ACL_##uppercase ? 1 : 0)
+
+// if there is a better way to cleanup a postgres hashtable
+// w/o recreating it, I didn't find it
+#define CLEAR_HTAB(entryType, hmap, key_name)                                  \
+  {                                                                            \
+    HASH_SEQ_STATUS hash_seq;                                                  \
+    entryType *src_entry;                                                      \
+    hash_seq_init(&hash_seq, hmap);                                            \
+    while ((src_entry = hash_seq_search(&hash_seq)) != NULL) {                 \
+      bool found;                                                              \
+      hash_search(hmap, &src_entry->key_name, HASH_REMOVE, &found);            \
+      Assert(found);                                                           \
+    }                                                                          \
+  }
+
+/**
+ * Must be called with relaccess_ht_lock held exclusively after merging into
+ * relaccesses. A sample with fewer entries than the previous one means we
+ * dumped in between, so it only restarts the measurement.
+ */
+static void update_fill_rate(TimestampTz now) {
+  long n_entries = hash_get_num_entries(relaccesses);
+  if (data->fill_rate_ts == 0 || n_entries < data->fill_rate_entries) {
+    data->fill_rate_ts = now;
+    data->fill_rate_entries = n_entries;
+    return;
+  }
+  int64 elapsed = now - data->fill_rate_ts;
+  if (elapsed < FILL_RATE_SAMPLE_USECS) {
+    return;
+  }
+  double elapsed_secs = (double)elapsed / USECS_PER_SEC;
+  double sample = (n_entries - data->fill_rate_entries) / elapsed_secs;
+  double weight = 1 - exp(-elapsed_secs / FILL_RATE_SMOOTHING_SECS);
+  data->fill_rate += weight * (sample - data->fill_rate);
+  data->fill_rate_ts = now;
+  data->fill_rate_entries = n_entries;
+}
+
+/**
+ * Must be called with relaccess_ht_lock held. Tells whether relaccesses is
+ * expected to overflow within gp_relaccess_stats.dump_horizon at the current
+ * fill rate, or right away with n_incoming more entries (think of a single
+ * query touching thousands of partitions).
+ */
+static bool need_predictive_dump(long n_incoming) {
+  long n_free = relaccess_size - hash_get_num_entries(relaccesses);
+  if (n_incoming > n_free) {
+    return true;
+  }
+  return data->fill_rate > 0 && n_free / data->fill_rate < dump_horizon;
+}
+
+/**
+ * Performs the dump a commit asked for by need_predictive_dump(). Called when
+ * a statement starts, so the cost is paid outside of any commit.
+ */
+static void relaccess_dump_if_requested(void) {
+  // an unlocked peek is fine, a missed request is seen by the next statement
+  if (Gp_role != GP_ROLE_DISPATCH || !data || !data->dump_requested) {
+    return;
+  }
+  relaccess_lock_acquire(data->relaccess_ht_lock, LW_EXCLUSIVE);
+  if (data->dump_requested) {
+    LOCAL_STAT_ADD(auto_dumps, 1);
+    relaccess_dump_to_files(false);
+  }
+  LWLockRelease(data->relaccess_ht_lock);
+}
+
+/**
+ * Collapses sorted local_accesses starting at *pos into merge_batch, one entry
+ * per relation. Several accesses by the same statement count as one query.
+ * If aborted_at is set, statements are only counted as aborted ones, and
+ * relations created by the transaction are skipped. Accesses rolled back to a
+ * savepoint are counted as aborted either way.
+ * Returns the number of entries in the batch.
+ */
+static int next_merge_batch(int *pos, TimestampTz aborted_at) {
+  int n = 0;
+  while (*pos < n_local_accesses && n < MERGE_BATCH_SZ) {
+    Oid relid = local_accesses[*pos].relid;
+    if (aborted_at != 0 && created_in_xact(relid)) {
+      // the relation is gone along with the transaction
+      while (*pos < n_local_accesses && local_accesses[*pos].relid == relid) {
+        (*pos)++;
+      }
+      continue;
+    }
+    mergeEntry *dst = &merge_batch[n++];
+    MemSet(dst, 0, sizeof(mergeEntry));
+    dst->relid = relid;
+    dst->first_access = *pos;
+    dst->last_reader_id = InvalidOid;
+    dst->last_writer_id = InvalidOid;
+    while (*pos < n_local_accesses &&
+           local_accesses[*pos].relid == dst->relid) {
+      int stmt_cnt = local_accesses[*pos].stmt_cnt;
+      TimestampTz aborted_start = 0;
+      TimestampTz stmt_aborted_at = 0;
+      AclMode perms = 0;
+      AclMode nested_perms = 0;
+      AclMode aborted_perms = 0;
+      for (; *pos < n_local_accesses &&
+             local_accesses[*pos].relid == dst->relid &&
+             local_accesses[*pos].stmt_cnt == stmt_cnt;
+           (*pos)++) {
+        localAccessEntry *src = &local_accesses[*pos];
+        if (src->aborted_at != 0 || aborted_at != 0) {
+          // aborted statements changed nothing, only their cost is recorded,
+          // see shift_aborted_accesses()
+          TimestampTz src_aborted_at =
+              src->aborted_at != 0 ? src->aborted_at : aborted_at;
+          if (src->counted) {
+            aborted_perms |= src->perms;
+          }
+          aborted_start =
+              aborted_start == 0 ? src->ts : Min(aborted_start, src->ts);
+          stmt_aborted_at = Max(stmt_aborted_at, src_aborted_at);
+          continue;
+        }
+        dst->via_view |= OidIsValid(src->viewid);
+        if (src->counted && src->nested) {
+          nested_perms |= src->perms;
+        } else if (src->counted) {
+          perms |= src->perms;
+        }
+        // using a sequence is its only kind of read
+        if ((is_read(src->perms) || (src->perms & ACL_USAGE)) &&
+            src->ts > dst->last_read) {
+          dst->last_read = src->ts;
+          dst->last_reader_id = src->user_id;
+        }
+        if (is_write(src->perms) && src->ts > dst->last_write) {
+          dst->last_write = src->ts;
+          dst->last_writer_id = src->user_id;
+        }
+        if ((src->perms & RELACCESS_DDL) && src->ts > dst->last_ddl) {
+          dst->last_ddl = src->ts;
+        }
+        if ((src->perms & RELACCESS_REWRITE) && src->ts > dst->last_rewrite) {
+          dst->last_rewrite = src->ts;
+        }
+        if (src->perms & RELACCESS_REFRESH) {
+          dst->last_refresh = Max(dst->last_refresh, src->ts);
+        }
+      }
+      if (aborted_perms != 0) {
+        dst->n_aborted++;
+        dst->aborted_time_ms += (stmt_aborted_at - aborted_start) / 1000;
+        dst->last_aborted = Max(dst->last_aborted, stmt_aborted_at);
+      }
+      if (perms == 0 && nested_perms == 0) {
+        continue;
+      }
+      COUNT_STAT(select, SELECT);
+      COUNT_STAT(insert, INSERT);
+      COUNT_STAT(update, UPDATE);
+      COUNT_STAT(delete, DELETE);
+      COUNT_STAT(truncate, TRUNCATE);
+      COUNT_STAT(usage, USAGE);
+      dst->n_ddl += (perms & RELACCESS_DDL) ? 1 : 0;
+      dst->n_rewrite += (perms & RELACCESS_REWRITE) ? 1 : 0;
+      dst->n_refresh += (perms & RELACCESS_REFRESH) ? 1 : 0;
+      // a top level statement sharing stmt_cnt with nested ones wins
+      dst->n_nested += (perms == 0 && nested_perms != 0) ? 1 : 0;
+    }
+    dst->n_accesses = *pos - dst->first_access;
+    if (dst->n_refresh > 0) {
+      int i;
+      for (i = 0; i < n_local_refreshes; i++) {
+        if (local_refreshes[i].relid == dst->relid) {
+          dst->refresh_time_ms += local_refreshes[i].time_ms;
+          dst->refresh_rows += local_refreshes[i].rows;
+        }
+      }
+    }
+    // we can't look the name up while committing or aborting, so if it is
+    // unknown for some reason, the name we have already got is kept
+    relnameCacheEntry *namecache_entry = (relnameCacheEntry *)hash_search(
+        relname_cache, &dst->relid, HASH_FIND, NULL);
+    dst->relname = namecache_entry ? namecache_entry->relname : NULL;
+  }
+  return n;
+}
+
+/**
+ * Must be called with relaccess_ht_lock held exclusively.
+ * src_entry->hashvalue must be computed for (dbid, relid) key.
+ * Unless can_dump is set, we never dump on overflow. With the sketch set up,
+ * relations w/o an entry are only given one as heavy hitters, the rest goes to
+ * the sketch, so there is neither overflow nor dump.
+ */
+static void merge_shared_entry(Oid dbid, mergeEntry *src_entry,
+                               bool can_dump) {
+  bool found;
+  relaccessHashKey key;
+  key.dbid = dbid;
+  key.relid = src_entry->relid;
+  long n_access_records = hash_get_num_entries(relaccesses);
+  relaccessEntry *dst_entry = NULL;
+  Assert(n_access_records <= relaccess_size);
+  if (relaccess_sketch) {
+    // exact entries are only made for heavy hitters, see relaccess_sketch
+    dst_entry = (relaccessEntry *)hash_search_with_hash_value(
+        relaccesses, &key, src_entry->hashvalue, HASH_FIND, &found);
+    if (!dst_entry && relaccess_hitters &&
+        n_access_records < relaccess_size &&
+        hash_search(relaccess_hitters, &key, HASH_FIND, NULL)) {
+      dst_entry = (relaccessEntry *)hash_search_with_hash_value(
+          relaccesses, &key, src_entry->hashvalue, HASH_ENTER_NULL, &found);
+    }
+    if (!dst_entry) {
+      sketch_add(dbid, src_entry);
+      return;
+    }
+  } else if (n_access_records == relaccess_size) {
+    // no room for new entries. Perhaps this relid is already being tracked?
+    dst_entry = (relaccessEntry *)hash_search_with_hash_value(
+        relaccesses, &key, src_entry->hashvalue, HASH_FIND, &found);
+    if (!dst_entry) {
+      LOCAL_STAT_ADD(overflows, 1);
+    }
+  } else {
+    dst_entry = (relaccessEntry *)hash_search_with_hash_value(
+        relaccesses, &key, src_entry->hashvalue, HASH_ENTER_NULL, &found);
+  }
+  if (dst_entry || (dump_on_overflow && can_dump)) {
+    if (!dst_entry) {
+      // we are out of shared memory and need to dump
+      relaccess_dump_to_files(false);
+      // we MUST have enough space now, unless we were unable to dump
+      dst_entry = (relaccessEntry *)hash_search_with_hash_value(
+          relaccesses, &key, src_entry->hashvalue, HASH_ENTER_NULL, &found);
+      if (!dst_entry) {
+        // still no memory left
+        account_lost_event(key.dbid);
+        if (!data->overflow_reported && !bench_private) {
+          elog(WARNING, ("gp_relaccess_stats.max_tables is exceeded and we "
+                         "are unable to dump hashtables to disk. "
+                         "Will start loosing some relaccess stats. "
+                         "See relaccess_stats_lost() for details"));
+          data->overflow_reported = true;
+        }
+        return;
+      }
+    }
+    if (!found) {
+      dst_entry->last_reader_id = InvalidOid;
+      dst_entry->last_writer_id = InvalidOid;
+      dst_entry->last_read = 0;
+      dst_entry->last_write = 0;
+      dst_entry->n_select = 0;
+      dst_entry->n_insert = 0;
+      dst_entry->n_update = 0;
+      dst_entry->n_delete = 0;
+      dst_entry->n_truncate = 0;
+      dst_entry->n_ddl = 0;
+      dst_entry->n_rewrite = 0;
+      dst_entry->last_ddl = 0;
+      dst_entry->last_rewrite = 0;
+      dst_entry->n_nested = 0;
+      dst_entry->n_aborted = 0;
+      dst_entry->last_aborted = 0;
+      dst_entry->aborted_time_ms = 0;
+      dst_entry->n_refresh = 0;
+      dst_entry->last_refresh = 0;
+      dst_entry->refresh_time_ms = 0;
+      dst_entry->refresh_rows = 0;
+      dst_entry->n_usage = 0;
+      dst_entry->relname[0] = '\0';
+    }
+    UPDATE_STAT(select);
+    UPDATE_STAT(insert);
+    UPDATE_STAT(update);
+    UPDATE_STAT(delete);
+    UPDATE_STAT(truncate);
+    UPDATE_STAT(ddl);
+    UPDATE_STAT(rewrite);
+    UPDATE_STAT(nested);
+    UPDATE_STAT(aborted);
+    UPDATE_STAT(refresh);
+    UPDATE_STAT(usage);
+    dst_entry->refresh_time_ms += src_entry->refresh_time_ms;
+    dst_entry->refresh_rows += src_entry->refresh_rows;
+    dst_entry->last_refresh =
+        Max(dst_entry->last_refresh, src_entry->last_refresh);
+    dst_entry->aborted_time_ms += src_entry->aborted_time_ms;
+    dst_entry->last_aborted =
+        Max(dst_entry->last_aborted, src_entry->last_aborted);
+    dst_entry->last_ddl = Max(dst_entry->last_ddl, src_entry->last_ddl);
+    dst_entry->last_rewrite =
+        Max(dst_entry->last_rewrite, src_entry->last_rewrite);
+    if (src_entry->last_read > dst_entry->last_read) {
+      dst_entry->last_read = src_entry->last_read;
+      dst_entry->last_reader_id = src_entry->last_reader_id;
+    }
+    if (src_entry->last_write > dst_entry->last_write) {
+      dst_entry->last_write = src_entry->last_write;
+      dst_entry->last_writer_id = src_entry->last_writer_id;
+    }
+    if (src_entry->relname) {
+      strlcpy(dst_entry->relname, src_entry->relname,
+              sizeof(dst_entry->relname));
+    }
+    LOCAL_STAT_ADD(entries_merged, 1);
+    if (relaccess_hitters) {
+      hitter_add_exact(dbid, src_entry);
+    }
+  } else {
+    account_lost_event(key.dbid);
+    if (!data->overflow_reported && !bench_private) {
+      elog(WARNING, "gp_relaccess_stats.max_tables is exceeded! New table "
+                    "events will be lost. "
+                    "Please execute relaccess_stats_update() and consider "
+                    "setting a hihger value. "
+                    "See relaccess_stats_lost() for details");
+      data->overflow_reported = true;
+    }
+  }
+}
+
+static void minheap_init(relaccessMinHeap *heap, int capacity,
+                         Size pos_offset) {
+  heap->n = 0;
+  heap->capacity = capacity;
+  heap->pos_offset = pos_offset;
+}
+
+static void minheap_set(relaccessMinHeap *heap, int pos,
+                        relaccessMinHeapItem item) {
+  heap->items[pos] = item;
+  MINHEAP_POS(heap, item.entry) = pos;
+}
+
+static void minheap_sift_up(relaccessMinHeap *heap, int pos) {
+  relaccessMinHeapItem item = heap->items[pos];
+  while (pos > 0) {
+    int parent = (pos - 1) / 2;
+    if (heap->items[parent].score <= item.score) {
+      break;
+    }
+    minheap_set(heap, pos, heap->items[parent]);
+    pos = parent;
+  }
+  minheap_set(heap, pos, item);
+}
+
+static void minheap_sift_down(relaccessMinHeap *heap, int pos) {
+  relaccessMinHeapItem item = heap->items[pos];
+  while (2 * pos + 1 < heap->n) {
+    int child = 2 * pos + 1;
+    if (child + 1 < heap->n &&
+        heap->items[child + 1].score < heap->items[child].score) {
+      child++;
+    }
+    if (item.score <= heap->items[child].score) {
+      break;
+    }
+    minheap_set(heap, pos, heap->items[child]);
+    pos = child;
+  }
+  minheap_set(heap, pos, item);
+}
+
+/**
+ * Adds entry to the heap or changes its score. There must be room for entry
+ * unless it is already in the heap.
+ */
+static void minheap_update(relaccessMinHeap *heap, void *entry, double score) {
+  int pos = MINHEAP_POS(heap, entry);
+  if (pos < 0) {
+    Assert(heap->n < heap->capacity);
+    pos = heap->n++;
+    heap->items[pos].entry = entry;
+    heap->items[pos].score = score;
+    minheap_sift_up(heap, pos);
+  } else if (score < heap->items[pos].score) {
+    heap->items[pos].score = score;
+    minheap_sift_up(heap, pos);
+  } else {
+    heap->items[pos].score = score;
+    minheap_sift_down(heap, pos);
+  }
+}
+
+static void minheap_remove(relaccessMinHeap *heap, void *entry) {
+  int pos = MINHEAP_POS(heap, entry);
+  if (pos < 0) {
+    return;
+  }
+  MINHEAP_POS(heap, entry) = -1;
+  if (pos == --heap->n) {
+    return;
+  }
+  minheap_set(heap, pos, heap->items[heap->n]);
+  if (pos > 0 && heap->items[pos].score < heap->items[(pos - 1) / 2].score) {
+    minheap_sift_up(heap, pos);
+  } else {
+    minheap_sift_down(heap, pos);
+  }
+}
+
+// recomputes all scores and restores the heap property in O(n)
+static void minheap_rebuild(relaccessMinHeap *heap,
+                            double (*score)(void *entry)) {
+  int i;
+  for (i = 0; i < heap->n; i++) {
+    heap->items[i].score = score(heap->items[i].entry);
+  }
+  for (i = heap->n / 2 - 1; i >= 0; i--) {
+    minheap_sift_down(heap, i);
+  }
+}
+
+/**
+ * Must be called with relaccess_ht_lock held exclusively. The entry to evict
+ * is taken from the root of relaccess_dim_heap, so a merge costs O(log n)
+ * even when the table is full. Entries are only ever accessed by their full
+ * key, dimension values with colliding hashes are kept apart.
+ */
+static void merge_dimension_entry(Oid dbid, mergeEntry *src_entry) {
+  bool found;
+  relaccessDimKey key;
+  relaccessDimEntry *dst_entry;
+  int64 overcount = 0;
+  uint32 hashvalue = src_entry->hashvalue ^ xact_dimension_hash;
+  MemSet(&key, 0, sizeof(key));
+  key.dbid = dbid;
+  key.relid = src_entry->relid;
+  key.kind = xact_dimension;
+  strlcpy(key.value, xact_dimension_value, sizeof(key.value));
+  dst_entry = hash_search_with_hash_value(relaccess_dims, &key, hashvalue,
+                                          HASH_FIND, NULL);
+  if (!dst_entry && relaccess_dim_heap->n >= max_dimension_entries) {
+    relaccessDimEntry *victim = relaccess_dim_heap->items[0].entry;
+    overcount = victim->n_reads + victim->n_writes + victim->overcount;
+    remove_dim_entry(victim);
+    LOCAL_STAT_ADD(dimension_evictions, 1);
+  }
+  if (!dst_entry) {
+    dst_entry = hash_search_with_hash_value(relaccess_dims, &key, hashvalue,
+                                            HASH_ENTER_NULL, &found);
+    if (!dst_entry) {
+      return;
+    }
+    dst_entry->n_reads = 0;
+    dst_entry->n_writes = 0;
+    dst_entry->overcount = overcount;
+    dst_entry->last_access = 0;
+    dst_entry->heap_pos = -1;
+  }
+  dst_entry->n_reads += src_entry->n_select;
+  dst_entry->n_writes += src_entry->n_insert + src_entry->n_update +
+                         src_entry->n_delete + src_entry->n_truncate;
+  dst_entry->last_access =
+      Max(dst_entry->last_access,
+          Max(src_entry->last_read, src_entry->last_write));
+  minheap_update(relaccess_dim_heap, dst_entry,
+                 (double)(dst_entry->n_reads + dst_entry->n_writes +
+                          dst_entry->overcount));
+}
+
+// Must be called with relaccess_ht_lock held exclusively
+static void remove_dim_entry(void *entry) {
+  minheap_remove(relaccess_dim_heap, entry);
+  hash_search(relaccess_dims, &((relaccessDimEntry *)entry)->key, HASH_REMOVE,
+              NULL);
+}
+
+// time constant of rate decay, in seconds
+#define RATE_TAU ((double)data->rate_half_life / M_LN2)
+
+// rate as of last_update decayed to now
+static double decay_rate(double rate, TimestampTz last_update,
+                         TimestampTz now) {
+  if (now <= last_update) {
+    return rate;
+  }
+  return rate * exp(-(double)(now - last_update) / USECS_PER_SEC / RATE_TAU);
+}
+
+static double rate_score(void *entry) {
+  relaccessRateEntry *rate_entry = (relaccessRateEntry *)entry;
+  return log(rate_entry->read_rate + rate_entry->write_rate) +
+         (double)rate_entry->last_update / USECS_PER_SEC / RATE_TAU;
+}
+
+/**
+ * Must be called with relaccess_ht_lock held exclusively. A burst of n
+ * queries adds n / tau to the rate, so a steady stream of r queries per second
+ * converges to r. When the table is full, the relation with the lowest current
+ * rate is evicted from the root of relaccess_rate_heap, so a merge costs
+ * O(log n). Relations merged w/o reads or writes are left alone, as decaying
+ * their rates changes neither their order nor their current values.
+ */
+static void merge_rate_entry(Oid dbid, mergeEntry *src_entry,
+                             TimestampTz now) {
+  bool found;
+  relaccessHashKey key;
+  int64 n_reads = src_entry->n_select;
+  int64 n_writes = src_entry->n_insert + src_entry->n_update +
+                   src_entry->n_delete + src_entry->n_truncate;
+  if (n_reads + n_writes == 0) {
+    return;
+  }
+  if (pushed_rate_half_life != rate_half_life) {
+    // Only a backend whose own setting changed applies it, the first one to
+    // reload does so for all. Backends yet to reload keep their stale value
+    // to themselves and don't flip the shared one back.
+    pushed_rate_half_life = rate_half_life;
+    if (data->rate_half_life != rate_half_life) {
+      // scores computed with another tau are not comparable, start over
+      data->rate_half_life = rate_half_life;
+      minheap_rebuild(relaccess_rate_heap, rate_score);
+      if (relaccess_top) {
+        minheap_rebuild(relaccess_top, rate_score);
+      }
+    }
+  }
+  key.dbid = dbid;
+  key.relid = src_entry->relid;
+  relaccessRateEntry *dst_entry =
+      hash_search(relaccess_rates, &key, HASH_FIND, NULL);
+  if (!dst_entry && relaccess_rate_heap->n >= max_rate_entries) {
+    remove_rate_entry(relaccess_rate_heap->items[0].entry);
+    LOCAL_STAT_ADD(rate_evictions, 1);
+  }
+  if (!dst_entry) {
+    dst_entry = hash_search(relaccess_rates, &key, HASH_ENTER_NULL, &found);
+    if (!dst_entry) {
+      return;
+    }
+    dst_entry->read_rate = 0;
+    dst_entry->write_rate = 0;
+    dst_entry->last_update = now;
+    dst_entry->heap_pos = -1;
+    dst_entry->top_pos = -1;
+  }
+  dst_entry->read_rate =
+      decay_rate(dst_entry->read_rate, dst_entry->last_update, now) +
+      n_reads / RATE_TAU;
+  dst_entry->write_rate =
+      decay_rate(dst_entry->write_rate, dst_entry->last_update, now) +
+      n_writes / RATE_TAU;
+  dst_entry->last_update = Max(dst_entry->last_update, now);
+  minheap_update(relaccess_rate_heap, dst_entry, rate_score(dst_entry));
+  if (relaccess_top) {
+    top_update(dst_entry);
+  }
+}
+
+/**
+ * Must be called with relaccess_ht_lock held exclusively, after entry's rates
+ * were brought up to now, i.e. its score may only have grown.
+ */
+static void top_update(relaccessRateEntry *entry) {
+  double score = rate_score(entry);
+  if (entry->top_pos < 0 && relaccess_top->n == top_size) {
+    if (score <= relaccess_top->items[0].score) {
+      return;
+    }
+    minheap_remove(relaccess_top, relaccess_top->items[0].entry);
+  }
+  minheap_update(relaccess_top, entry, score);
+}
+
+/**
+ * Must be called with relaccess_ht_lock held exclusively. Fills slots of
+ * relaccess_top left by removed entries with the fastest entries not in it.
+ * Scans all rate entries, so it is only called once relations are forgotten:
+ * the slowest entry, evicted when the table is full, is never in a full top
+ * unless all entries are.
+ */
+static void top_refill(void) {
+  int i;
+  if (relaccess_top->n == top_size) {
+    return;
+  }
+  for (i = 0; i < relaccess_rate_heap->n; i++) {
+    relaccessRateEntry *entry = relaccess_rate_heap->items[i].entry;
+    if (entry->top_pos < 0) {
+      top_update(entry);
+    }
+  }
+}
+
+// Must be called with relaccess_ht_lock held exclusively
+static void remove_rate_entry(void *entry) {
+  minheap_remove(relaccess_rate_heap, entry);
+  if (relaccess_top) {
+    minheap_remove(relaccess_top, entry);
+  }
+  hash_search(relaccess_rates, &((relaccessRateEntry *)entry)->key,
+              HASH_REMOVE, NULL);
+}
+
+/**
+ * Cells of a relation, one per row, are picked by double hashing of the
+ * relaccesses hash value
+ */
+static relaccessSketchCell *sketch_cell(uint32 hashvalue, int row) {
+  uint32 step = DatumGetUInt32(hash_uint32(hashvalue)) | 1;
+  return &relaccess_sketch[row * sketch_width +
+                           (hashvalue + row * step) % sketch_width];
+}
+
+// the smallest counters of a relation over all rows are its estimates
+static void sketch_estimate(uint32 hashvalue, relaccessSketchCell *estimate) {
+  int row;
+  *estimate = *sketch_cell(hashvalue, 0);
+  for (row = 1; row < sketch_depth; row++) {
+    relaccessSketchCell *cell = sketch_cell(hashvalue, row);
+    estimate->n_select = Min(estimate->n_select, cell->n_select);
+    estimate->n_insert = Min(estimate->n_insert, cell->n_insert);
+    estimate->n_update = Min(estimate->n_update, cell->n_update);
+    estimate->n_delete = Min(estimate->n_delete, cell->n_delete);
+    estimate->n_truncate = Min(estimate->n_truncate, cell->n_truncate);
+  }
+}
+
+/**
+ * Must be called with relaccess_ht_lock held exclusively. A relation is only
+ * inserted into a full table if its estimate exceeds the lowest one, which is
+ * then evicted, so a merge costs O(log n).
+ */
+static void merge_hitter(Oid dbid, mergeEntry *src_entry, int64 n_reads,
+                         int64 n_writes) {
+  relaccessHashKey key;
+  key.dbid = dbid;
+  key.relid = src_entry->relid;
+  relaccessHitterEntry *entry =
+      hash_search(relaccess_hitters, &key, HASH_FIND, NULL);
+  if (!entry) {
+    if (relaccess_hitter_heap->n >= sketch_heavy_hitters) {
+      double score = (double)(n_reads + n_writes);
+      if (score <= relaccess_hitter_heap->items[0].score) {
+        return;
+      }
+      remove_hitter(relaccess_hitter_heap->items[0].entry);
+      LOCAL_STAT_ADD(hitter_evictions, 1);
+    }
+    entry = hash_search(relaccess_hitters, &key, HASH_ENTER_NULL, NULL);
+    if (!entry) {
+      return;
+    }
+    entry->relname[0] = '\0';
+    entry->last_reader_id = InvalidOid;
+    entry->last_writer_id = InvalidOid;
+    entry->last_read = 0;
+    entry->last_write = 0;
+    entry->heap_pos = -1;
+  }
+  entry->n_reads = n_reads;
+  entry->n_writes = n_writes;
+  if (src_entry->last_read > entry->last_read) {
+    entry->last_read = src_entry->last_read;
+    entry->last_reader_id = src_entry->last_reader_id;
+  }
+  if (src_entry->last_write > entry->last_write) {
+    entry->last_write = src_entry->last_write;
+    entry->last_writer_id = src_entry->last_writer_id;
+  }
+  if (src_entry->relname) {
+    strlcpy(entry->relname, src_entry->relname, sizeof(entry->relname));
+  }
+  minheap_update(relaccess_hitter_heap, entry, (double)(n_reads + n_writes));
+}
+
+// Must be called with relaccess_ht_lock held exclusively
+static void remove_hitter(void *entry) {
+  minheap_remove(relaccess_hitter_heap, entry);
+  hash_search(relaccess_hitters, &((relaccessHitterEntry *)entry)->key,
+              HASH_REMOVE, NULL);
+}
+
+/**
+ * Must be called with relaccess_ht_lock held exclusively. Only select, insert,
+ * update, delete and truncate queries are estimated, other counters are lost.
+ * Timestamps are only kept for heavy hitters.
+ */
+static void sketch_add(Oid dbid, mergeEntry *src_entry) {
+  int row;
+  relaccessSketchCell estimate;
+  if (src_entry->n_select == 0 && SKETCH_WRITES(src_entry) == 0) {
+    return;
+  }
+  for (row = 0; row < sketch_depth; row++) {
+    relaccessSketchCell *cell = sketch_cell(src_entry->hashvalue, row);
+    cell->n_select += src_entry->n_select;
+    cell->n_insert += src_entry->n_insert;
+    cell->n_update += src_entry->n_update;
+    cell->n_delete += src_entry->n_delete;
+    cell->n_truncate += src_entry->n_truncate;
+  }
+  LOCAL_STAT_ADD(sketched_entries, 1);
+  if (relaccess_hitters) {
+    sketch_estimate(src_entry->hashvalue, &estimate);
+    merge_hitter(dbid, src_entry, estimate.n_select, SKETCH_WRITES(&estimate));
+  }
+}
+
+/**
+ * Must be called with relaccess_ht_lock held exclusively. Exact accesses of a
+ * heavy hitter are added to its counters, otherwise it would soon be evicted
+ * by sketched relations, as its sketch estimates don't grow anymore.
+ */
+static void hitter_add_exact(Oid dbid, mergeEntry *src_entry) {
+  relaccessHashKey key;
+  key.dbid = dbid;
+  key.relid = src_entry->relid;
+  relaccessHitterEntry *entry =
+      hash_search(relaccess_hitters, &key, HASH_FIND, NULL);
+  if (entry) {
+    merge_hitter(dbid, src_entry, entry->n_reads + src_entry->n_select,
+                 entry->n_writes + SKETCH_WRITES(src_entry));
+  }
+}
+
+/**
+ * Must be called with relaccess_ht_lock held exclusively. Relations merged
+ * w/o reads or writes, e.g. only altered, are indexed as well, with zero
+ * timestamps meaning they were not read or written since the index start.
+ */
+static void merge_time_slot(Oid dbid, mergeEntry *src_entry) {
+  bool found;
+  relaccessHashKey key;
+  key.dbid = dbid;
+  key.relid = src_entry->relid;
+  relaccessTimeSlot *entry =
+      hash_search(relaccess_time_slots, &key, HASH_FIND, NULL);
+  if (!entry) {
+    if (*time_slots_used >= max_time_slots) {
+      relaccessTimeSlot *victim = relaccess_time_heap->items[0].entry;
+      *time_index_since =
+          Max(*time_index_since,
+              Max(time_slot_last_read[victim->slot],
+                  time_slot_last_write[victim->slot]));
+      remove_time_slot(victim);
+      LOCAL_STAT_ADD(time_slot_evictions, 1);
+    }
+    entry = hash_search(relaccess_time_slots, &key, HASH_ENTER_NULL, &found);
+    if (!entry) {
+      return;
+    }
+    entry->slot = (*time_slots_used)++;
+    entry->heap_pos = -1;
+    time_slot_dbid[entry->slot] = dbid;
+    time_slot_relid[entry->slot] = src_entry->relid;
+    time_slot_last_read[entry->slot] = 0;
+    time_slot_last_write[entry->slot] = 0;
+  }
+  time_slot_last_read[entry->slot] =
+      Max(time_slot_last_read[entry->slot], src_entry->last_read);
+  time_slot_last_write[entry->slot] =
+      Max(time_slot_last_write[entry->slot], src_entry->last_write);
+  minheap_update(relaccess_time_heap, entry,
+                 (double)Max(time_slot_last_read[entry->slot],
+                             time_slot_last_write[entry->slot]));
+}
+
+/**
+ * Must be called with relaccess_ht_lock held exclusively. The last slot is
+ * moved into the freed one to keep slots in use contiguous.
+ */
+static void remove_time_slot(void *entry) {
+  relaccessTimeSlot *slot_entry = (relaccessTimeSlot *)entry;
+  int slot = slot_entry->slot;
+  int last = --(*time_slots_used);
+  minheap_remove(relaccess_time_heap, slot_entry);
+  hash_search(relaccess_time_slots, &slot_entry->key, HASH_REMOVE, NULL);
+  if (slot != last) {
+    relaccessHashKey key;
+    key.dbid = time_slot_dbid[last];
+    key.relid = time_slot_relid[last];
+    relaccessTimeSlot *moved =
+        hash_search(relaccess_time_slots, &key, HASH_FIND, NULL);
+    Assert(moved);
+    moved->slot = slot;
+    time_slot_dbid[slot] = time_slot_dbid[last];
+    time_slot_relid[slot] = time_slot_relid[last];
+    time_slot_last_read[slot] = time_slot_last_read[last];
+    time_slot_last_write[slot] = time_slot_last_write[last];
+  }
+}
+
+/**
+ * Must be called with relaccess_ht_lock held exclusively, while local_accesses
+ * are sorted. Several accesses of a table through the same view by the same
+ * statement count as one query.
+ */
+static void merge_view_links(Oid dbid, mergeEntry *src_entry) {
+  relaccessViewLinkKey key;
+  int end = src_entry->first_access + src_entry->n_accesses;
+  int i;
+  // accesses are sorted by statement and view, the last one linked
+  localAccessEntry *linked = NULL;
+  MemSet(&key, 0, sizeof(key));
+  key.dbid = dbid;
+  for (i = src_entry->first_access; i < end; i++) {
+    localAccessEntry *src = &local_accesses[i];
+    bool found;
+    // accesses rolled back to a savepoint are not linked
+    if (!OidIsValid(src->viewid) || src->aborted_at != 0 ||
+        (linked && linked->stmt_cnt == src->stmt_cnt &&
+         linked->viewid == src->viewid)) {
+      continue;
+    }
+    linked = src;
+    key.viewid = src->viewid;
+    key.relid = src->relid;
+    relaccessViewLinkEntry *entry =
+        hash_search(relaccess_view_links, &key, HASH_ENTER_NULL, &found);
+    if (!entry) {
+      LOCAL_STAT_ADD(dropped_view_links, 1);
+      continue;
+    }
+    if (!found) {
+      entry->n_queries = 0;
+      entry->last_access = 0;
+    }
+    entry->n_queries++;
+    entry->last_access = Max(entry->last_access, src->ts);
+  }
+}
+
+/**
+ * Local accesses are sorted by relid and collapsed into batches of
+ * MERGE_BATCH_SZ relations. Hash values are computed before taking
+ * relaccess_ht_lock, and each batch is looked up in hash order, so consecutive
+ * lookups hit neighbouring buckets. The lock is released between batches,
+ * which bounds its hold time for queries sweeping thousands of partitions.
+ * Accesses of an aborted transaction are merged with aborted_at set. As we
+ * can't afford failing in the middle of abort, such merges never dump.
+ */
+static void relaccess_merge_local_entries(Oid dbid, TimestampTz aborted_at) {
+  relaccessPhase prev_phase = set_phase(PHASE_MERGE);
+  TimestampTz now = GetCurrentTimestamp();
+  bool first_batch = true;
+  int pos = 0;
+  int n_relations = 0;
+  int n_batch, i;
+  if (aborted_at != 0) {
+    shift_aborted_accesses(aborted_at);
+    qsort(created_relations, n_created_relations, sizeof(xactRelation),
+          relid_cmp);
+  }
+  qsort(local_accesses, n_local_accesses, sizeof(localAccessEntry),
+        local_access_cmp);
+  // a relation accessed many times takes a single entry
+  for (i = 0; i < n_local_accesses; i++) {
+    if (i == 0 || local_accesses[i].relid != local_accesses[i - 1].relid) {
+      n_relations++;
+    }
+  }
+  while ((n_batch = next_merge_batch(&pos, aborted_at)) > 0) {
+    for (i = 0; i < n_batch; i++) {
+      relaccessHashKey key;
+      key.dbid = dbid;
+      key.relid = merge_batch[i].relid;
+      merge_batch[i].hashvalue = get_hash_value(relaccesses, &key);
+    }
+    qsort(merge_batch, n_batch, sizeof(mergeEntry), merge_entry_hash_cmp);
+    relaccess_lock_acquire(data->relaccess_ht_lock, LW_EXCLUSIVE);
+    if (first_batch && dump_horizon > 0 && aborted_at == 0 &&
+        !relaccess_sketch && need_predictive_dump(n_relations)) {
+      // dumping writes files for every database, which we don't want to wait
+      // for while committing. The next statement of any backend does it
+      data->dump_requested = true;
+    }
+    first_batch = false;
+    for (i = 0; i < n_batch; i++) {
+      merge_shared_entry(dbid, &merge_batch[i], aborted_at == 0);
+      if (xact_dimension != DIMENSION_NONE && relaccess_dims &&
+          aborted_at == 0) {
+        merge_dimension_entry(dbid, &merge_batch[i]);
+      }
+      if (relaccess_rates && aborted_at == 0) {
+        merge_rate_entry(dbid, &merge_batch[i], now);
+      }
+      if (relaccess_time_slots && aborted_at == 0) {
+        merge_time_slot(dbid, &merge_batch[i]);
+      }
+      if (relaccess_view_links && merge_batch[i].via_view && aborted_at == 0) {
+        merge_view_links(dbid, &merge_batch[i]);
+      }
+    }
+    if (pos == n_local_accesses && !bench_private) {
+      update_fill_rate(now);
+    }
+    LWLockRelease(data->relaccess_ht_lock);
+  }
+  set_phase(prev_phase);
+}
+
+static void relaccess_xact_callback(XactEvent event, void *arg) {
+  if (Gp_role != GP_ROLE_DISPATCH) {
+    return;
+  }
+  if (is_enabled) {
+    if (event == XACT_EVENT_COMMIT) {
+      if (n_local_accesses > 0) {
+        instr_time start, duration;
+        INSTR_TIME_SET_CURRENT(start);
+        relaccess_merge_local_entries(MyDatabaseId, 0);
+        INSTR_TIME_SET_CURRENT(duration);
+        INSTR_TIME_SUBTRACT(duration, start);
+        record_latency(LATENCY_COMMIT_MERGE, duration);
+      }
+      reset_local_accesses();
+    } else if (event == XACT_EVENT_ABORT) {
+      if (n_local_accesses > 0 && track_aborted) {
+        relaccess_merge_local_entries(MyDatabaseId, GetCurrentTimestamp());
+      }
+      reset_local_accesses();
+    }
+  }
+  if (event == XACT_EVENT_COMMIT || event == XACT_EVENT_ABORT) {
+    n_subxact_offsets = 0;
+    if (event == XACT_EVENT_COMMIT && n_dropped_relations > 0) {
+      forget_dropped_relations();
+    }
+    n_dropped_relations = 0;
+    n_stmt_ends = 0;
+    n_local_refreshes = 0;
+    n_created_relations = 0;
+    if (local_stats_dirty) {
+      flush_internal_stats();
+    }
+    // we might have errored out in the middle of something
+    if (current_phase != PHASE_NONE) {
+      set_phase(PHASE_NONE);
+    }
+  }
+}
+
+/**
+ * Accesses of a committed subtransaction simply stay in local_accesses and
+ * belong to the parent from now on. Those of an aborted one stay as well, to
+ * be counted as aborted, see keep_aborted_accesses(), or are cut off unless
+ * gp_relaccess_stats.track_aborted is on. The offsets are maintained even when
+ * tracking is disabled, as it may get enabled in the middle of a
+ * subtransaction.
+ */
+static void relaccess_subxact_callback(SubXactEvent event,
+                                       SubTransactionId mySubid,
+                                       SubTransactionId parentSubid,
+                                       void *arg) {
+  if (Gp_role != GP_ROLE_DISPATCH) {
+    return;
+  }
+  if (event == SUBXACT_EVENT_START_SUB) {
+    if (n_subxact_offsets == subxact_offsets_capacity) {
+      if (subxact_offsets == NULL) {
+        subxact_offsets_capacity = SUBXACT_OFFSETS_SZ;
+        subxact_offsets = MemoryContextAlloc(
+            TopMemoryContext, sizeof(int) * subxact_offsets_capacity);
+      } else {
+        subxact_offsets_capacity *= 2;
+        subxact_offsets = repalloc(subxact_offsets,
+                                   sizeof(int) * subxact_offsets_capacity);
+      }
+    }
+    subxact_offsets[n_subxact_offsets++] = n_local_accesses;
+  } else if (event == SUBXACT_EVENT_COMMIT_SUB) {
+    if (n_subxact_offsets > 0) {
+      n_subxact_offsets--;
+    }
+  } else if (event == SUBXACT_EVENT_ABORT_SUB) {
+    if (n_subxact_offsets > 0) {
+      int offset = subxact_offsets[--n_subxact_offsets];
+      Assert(offset <= n_local_accesses);
+      if (track_aborted) {
+        keep_aborted_accesses(offset, mySubid);
+      } else {
+        n_local_accesses = offset;
+      }
+      while (n_stmt_ends > 0 && stmt_ends[n_stmt_ends - 1].last > offset) {
+        n_stmt_ends--;
+      }
+      while (n_local_refreshes > 0 &&
+             local_refreshes[n_local_refreshes - 1].access >= offset) {
+        n_local_refreshes--;
+      }
+    }
+    // the aborted one and its children were started after its parent
+    while (n_dropped_relations > 0 &&
+           dropped_relations[n_dropped_relations - 1].subid >= mySubid) {
+      n_dropped_relations--;
+    }
+  }
+}
+
+Datum relaccess_stats_update(PG_FUNCTION_ARGS) {
+  relaccess_stats_update_internal();
+  PG_RETURN_VOID();
+}
+
+Datum relaccess_stats_dump(PG_FUNCTION_ARGS) {
+  relaccess_lock_acquire(data->relaccess_ht_lock, LW_EXCLUSIVE);
+  relaccess_dump_to_files(true);
+  LWLockRelease(data->relaccess_ht_lock);
+  PG_RETURN_VOID();
+}
+
+Datum relaccess_stats_fillfactor(PG_FUNCTION_ARGS) {
+  relaccess_lock_acquire(data->relaccess_ht_lock, LW_SHARED);
+  int16_t fillfactor = hash_get_num_entries(relaccesses) * 100 / relaccess_size;
+  LWLockRelease(data->relaccess_ht_lock);
+  PG_RETURN_INT16(fillfactor);
+}
+
+Datum relaccess_stats_fill_rate(PG_FUNCTION_ARGS) {
+  relaccess_lock_acquire(data->relaccess_ht_lock, LW_SHARED);
+  double fill_rate = data->fill_rate;
+  LWLockRelease(data->relaccess_ht_lock);
+  PG_RETURN_FLOAT8(fill_rate);
+}
+
+Datum relaccess_stats_from_dump(PG_FUNCTION_ARGS) {
+  FuncCallContext *funcctx;
+  List *stats_entries = NIL;
+
+  if (SRF_IS_FIRSTCALL()) {
+    funcctx = SRF_FIRSTCALL_INIT();
+    MemoryContext oldcontext =
+        MemoryContextSwitchTo(funcctx->multi_call_memory_ctx);
+    TupleDesc tupdesc = CreateTemplateTupleDesc(24, false /* hasoid */);
+    TupleDescInitEntry(tupdesc, (AttrNumber)1, "relid", OIDOID, -1 /* typmod */,
+                       0 /* attdim */);
+    TupleDescInitEntry(tupdesc, (AttrNumber)2, "relname", NAMEOID,
+                       -1 /* typmod */, 0 /* attdim */);
+    TupleDescInitEntry(tupdesc, (AttrNumber)3, "last_reader_id", OIDOID,
+                       -1 /* typmod */, 0 /* attdim */);
+    TupleDescInitEntry(tupdesc, (AttrNumber)4, "last_writer_id", OIDOID,
+                       -1 /* typmod */, 0 /* attdim */);
+    TupleDescInitEntry(tupdesc, (AttrNumber)5, "last_read", TIMESTAMPTZOID,
+                       -1 /* typmod */, 0 /* attdim */);
+    TupleDescInitEntry(tupdesc, (AttrNumber)6, "last_write", TIMESTAMPTZOID,
+                       -1 /* typmod */, 0 /* attdim */);
+    TupleDescInitEntry(tupdesc, (AttrNumber)7, "n_select_queries", INT4OID,
+                       -1 /* typmod */, 0 /* attdim */);
+    TupleDescInitEntry(tupdesc, (AttrNumber)8, "n_insert_queries", INT4OID,
+                       -1 /* typmod */, 0 /* attdim */);
+    TupleDescInitEntry(tupdesc, (AttrNumber)9, "n_update_queries", INT4OID,
+                       -1 /* typmod */, 0 /* attdim */);
+    TupleDescInitEntry(tupdesc, (AttrNumber)10, "n_delete_queries", INT4OID,
+                       -1 /* typmod */, 0 /* attdim */);
+    TupleDescInitEntry(tupdesc, (AttrNumber)11, "n_truncate_queries", INT4OID,
+                       -1 /* typmod */, 0 /* attdim */);
+    TupleDescInitEntry(tupdesc, (AttrNumber)12, "n_ddl_queries", INT4OID,
+                       -1 /* typmod */, 0 /* attdim */);
+    TupleDescInitEntry(tupdesc, (AttrNumber)13, "n_rewrite_queries", INT4OID,
+                       -1 /* typmod */, 0 /* attdim */);
+    TupleDescInitEntry(tupdesc, (AttrNumber)14, "last_ddl", TIMESTAMPTZOID,
+                       -1 /* typmod */, 0 /* attdim */);
+    TupleDescInitEntry(tupdesc, (AttrNumber)15, "last_rewrite", TIMESTAMPTZOID,
+                       -1 /* typmod */, 0 /* attdim */);
+    TupleDescInitEntry(tupdesc, (AttrNumber)16, "n_nested_queries", INT4OID,
+                       -1 /* typmod */, 0 /* attdim */);
+    TupleDescInitEntry(tupdesc, (AttrNumber)17, "n_aborted_queries", INT4OID,
+                       -1 /* typmod */, 0 /* attdim */);
+    TupleDescInitEntry(tupdesc, (AttrNumber)18, "last_aborted", TIMESTAMPTZOID,
+                       -1 /* typmod */, 0 /* attdim */);
+    TupleDescInitEntry(tupdesc, (AttrNumber)19, "aborted_time_ms", INT8OID,
+                       -1 /* typmod */, 0 /* attdim */);
+    TupleDescInitEntry(tupdesc, (AttrNumber)20, "n_refresh_queries", INT4OID,
+                       -1 /* typmod */, 0 /* attdim */);
+    TupleDescInitEntry(tupdesc, (AttrNumber)21, "last_refresh", TIMESTAMPTZOID,
+                       -1 /* typmod */, 0 /* attdim */);
+    TupleDescInitEntry(tupdesc, (AttrNumber)22, "refresh_time_ms", INT8OID,
+                       -1 /* typmod */, 0 /* attdim */);
+    TupleDescInitEntry(tupdesc, (AttrNumber)23, "refresh_rows", INT8OID,
+                       -1 /* typmod */, 0 /* attdim */);
+    TupleDescInitEntry(tupdesc, (AttrNumber)24, "n_usage_queries", INT4OID,
+                       -1 /* typmod */, 0 /* attdim */);
+    funcctx->tuple_desc = BlessTupleDesc(tupdesc);
+    StringInfoData dump_file = get_dump_filename(MyDatabaseId);
+    stats_entries = read_dump_file(dump_file.data);
+    pfree(dump_file.data);
+    funcctx->user_fctx = stats_entries;
+    MemoryContextSwitchTo(oldcontext);
+  }
+
+  funcctx = SRF_PERCALL_SETUP();
+  stats_entries = (List *)funcctx->user_fctx;
+
+  while (true) {
+    if (stats_entries == NIL) {
+      SRF_RETURN_DONE(funcctx);
+    }
+    relaccessEntry *entry = linitial(stats_entries);
+    stats_entries = list_delete_first(stats_entries);
+    Datum values[24];
+    bool nulls[24];
+    MemSet(nulls, 0, sizeof(nulls));
+    values[0] = ObjectIdGetDatum(entry->key.relid);
+    values[1] = CStringGetDatum(entry->relname);
+    values[2] = ObjectIdGetDatum(entry->last_reader_id);
+    values[3] = ObjectIdGetDatum(entry->last_writer_id);
+    values[4] = TimestampTzGetDatum(entry->last_read);
+    values[5] = TimestampTzGetDatum(entry->last_write);
+    values[6] = Int32GetDatum(entry->n_select);
+    values[7] = Int32GetDatum(entry->n_insert);
+    values[8] = Int32GetDatum(entry->n_update);
+    values[9] = Int32GetDatum(entry->n_delete);
+    values[10] = Int32GetDatum(entry->n_truncate);
+    values[11] = Int32GetDatum(entry->n_ddl);
+    values[12] = Int32GetDatum(entry->n_rewrite);
+    values[13] = TimestampTzGetDatum(entry->last_ddl);
+    values[14] = TimestampTzGetDatum(entry->last_rewrite);
+    values[15] = Int32GetDatum(entry->n_nested);
+    values[16] = Int32GetDatum(entry->n_aborted);
+    values[17] = TimestampTzGetDatum(entry->last_aborted);
+    values[18] = Int64GetDatum(entry->aborted_time_ms);
+    values[19] = Int32GetDatum(entry->n_refresh);
+    values[20] = TimestampTzGetDatum(entry->last_refresh);
+    values[21] = Int64GetDatum(entry->refresh_time_ms);
+    values[22] = Int64GetDatum(entry->refresh_rows);
+    values[23] = Int32GetDatum(entry->n_usage);
+    HeapTuple tuple = heap_form_tuple(funcctx->tuple_desc, values, nulls);
+    Datum result = HeapTupleGetDatum(tuple);
+    funcctx->user_fctx = stats_entries;
+    /** NOTE: Cannot delete entry from this iteration right now.
+     * For now let's rely on multi_call_memory_ctx until there is a proven
+     * memory problem with this codepath
+     */
+    // pfree(entry);
+    SRF_RETURN_NEXT(funcctx, result);
+  }
+}
+
+static void relaccess_stats_update_internal() {
+  relaccess_lock_acquire(data->relaccess_ht_lock, LW_EXCLUSIVE);
+  relaccess_dump_to_files(true);
+  LWLockRelease(data->relaccess_ht_lock);
+  relaccess_upsert_from_file();
+}
+
+static void add_file_dump_entry(Oid dbid, HTAB *ht) {
+  bool found;
+  fileDumpEntry *file_entry = hash_search(ht, &dbid, HASH_ENTER, &found);
+  if (!found) {
+    file_entry->dbid = dbid;
+    StringInfoData filename = get_dump_filename(file_entry->dbid);
+    file_entry->filename = filename.data;
+    file_entry->file = open_dump_file_for_append(file_entry->filename);
+  }
+}
+
+static void relaccess_dump_to_files(bool only_this_db) {
+  HTAB *file_mapping;
+  HASHCTL ctl;
+  instr_time start, duration;
+  relaccessPhase prev_phase = set_phase(PHASE_DUMP);
+  INSTR_TIME_SET_CURRENT(start);
+  MemSet(&ctl, 0, sizeof(ctl));
+  ctl.keysize = sizeof(Oid);
+  ctl.entrysize = sizeof(fileDumpEntry);
+  ctl.hash = oid_hash;
+  file_mapping = hash_create("Relaccess dump files", FILE_CACHE_SZ, &ctl,
+                             HASH_ELEM | HASH_FUNCTION);
+  relaccess_lock_acquire(data->relaccess_file_lock, LW_EXCLUSIVE);
+  if (only_this_db) {
+    add_file_dump_entry(MyDatabaseId, file_mapping);
+  } else {
+    HASH_SEQ_STATUS hash_seq;
+    relaccessEntry *access_entry;
+    hash_seq_init(&hash_seq, relaccesses);
+    while ((access_entry = hash_seq_search(&hash_seq)) != NULL) {
+      add_file_dump_entry(access_entry->key.dbid, file_mapping);
+    }
+  }
+  int64 n_dumped = relaccess_dump_to_files_internal(file_mapping);
+  HASH_SEQ_STATUS hash_seq;
+  hash_seq_init(&hash_seq, file_mapping);
+  fileDumpEntry *entry;
+  while ((entry = hash_seq_search(&hash_seq)) != NULL) {
+    FreeFile(entry->file);
+    pfree(entry->filename);
+  }
+  LWLockRelease(data->relaccess_file_lock);
+  hash_destroy(file_mapping);
+  if (!only_this_db) {
+    data->dump_requested = false;
+  }
+  INSTR_TIME_SET_CURRENT(duration);
+  INSTR_TIME_SUBTRACT(duration, start);
+  LOCAL_STAT_ADD(dumps, 1);
+  LOCAL_STAT_ADD(dumped_entries, n_dumped);
+  LOCAL_STAT_ADD(dumped_bytes, n_dumped * sizeof(relaccessEntry));
+  LOCAL_STAT_ADD(dump_us, INSTR_TIME_GET_MICROSEC(duration));
+  record_latency(LATENCY_DUMP, duration);
+  set_phase(prev_phase);
+}
+
+static int64 relaccess_dump_to_files_internal(HTAB *files) {
+  HASH_SEQ_STATUS hash_seq;
+  relaccessEntry *entry;
+  int64 n_dumped = 0;
+  hash_seq_init(&hash_seq, relaccesses);
+  while ((entry = hash_seq_search(&hash_seq)) != NULL) {
+    bool found;
+    fileDumpEntry *dumpfile =
+        hash_search(files, &entry->key.dbid, HASH_FIND, &found);
+    if (!found) {
+      // we don't want to dump events from this DB
+      continue;
+    }
+    if (fwrite(entry, sizeof(relaccessEntry), 1, dumpfile->file) != 1) {
+      hash_seq_term(&hash_seq);
+      ereport(WARNING,
+              (errcode_for_file_access(),
+               errmsg("could not write gp_relaccess_stats file \"%s\": %m",
+                      dumpfile->filename)));
+      break;
+    }
+    hash_search(relaccesses, &entry->key, HASH_REMOVE, &found);
+    data->overflow_reported = false;
+    n_dumped++;
+  }
+  // restart fill rate measurement from the new number of entries
+  data->fill_rate_ts = 0;
+  return n_dumped;
+}
+
+static void relaccess_upsert_from_file() {
+  int ret;
+  if ((ret = SPI_connect()) < 0) {
+    elog(ERROR, "SPI connect failure - returned %d", ret);
+  }
+  relaccess_lock_acquire(data->relaccess_file_lock, LW_EXCLUSIVE);
+  StringInfoData filename = get_dump_filename(MyDatabaseId);
+  StringInfoData query;
+  initStringInfo(&query);
+  appendStringInfo(&query,
+                   "SELECT relaccess.__relaccess_upsert_from_dump_file()");
+  relaccessPhase prev_phase = set_phase(PHASE_UPSERT);
+  ret = SPI_execute(query.data, false, 1);
+  set_phase(prev_phase);
+  unlink(filename.data);
+  LWLockRelease(data->relaccess_file_lock);
+  SPI_finish();
+  if (ret < 0) {
+    elog(ERROR, "SPI execute failure - returned %d", ret);
+  }
+}
+
+/**
+ * Returns NULL if relname is not given and relid doesn't exist anymore.
+ * Relations with a given relname are taken as permanent w/o looking them up.
+ */
+static relnameCacheEntry *update_relname_cache(Oid relid, char *relname) {
+  bool found;
+  relnameCacheEntry *relname_entry = (relnameCacheEntry *)hash_search(
+      relname_cache, &relid, HASH_ENTER, &found);
+  if (!found) {
+    relname_entry->relid = relid;
+    relname_entry->relpersistence = RELPERSISTENCE_PERMANENT;
+    relname_entry->relkind = RELKIND_RELATION;
+    if (relname) {
+      strlcpy(relname_entry->relname, relname, sizeof(relname_entry->relname));
+    } else {
+      // a single syscache lookup gets name, persistence and kind
+      HeapTuple tp = SearchSysCache1(RELOID, ObjectIdGetDatum(relid));
+      if (!HeapTupleIsValid(tp)) {
+        hash_search(relname_cache, &relid, HASH_REMOVE, NULL);
+        return NULL;
+      }
+      Form_pg_class reltup = (Form_pg_class)GETSTRUCT(tp);
+      strlcpy(relname_entry->relname, NameStr(reltup->relname),
+              sizeof(relname_entry->relname));
+      relname_entry->relpersistence = reltup->relpersistence;
+      relname_entry->relkind = reltup->relkind;
+      ReleaseSysCache(tp);
+    }
+  } else {
+    /**
+     * NOTE: as we don't handle the 'else' clause here, there will be cases when
+     * we write outdated table names, like below:
+     *    BEGIN;
+     *      INSERT INTO tbl VALUES (1);
+     *      ALTER TABLE tbl RENAME TO new_tbl;
+     *      SELECT * FROM new_tbl;
+     *    COMMIT;
+     * In this case both INSERT and SELECT stmts would be counted with the
+     * old'tbl' name, as we don't update our cache for already known relids in
+     * the same transaction. This is a deliberate decision for performance
+     * reasons.
+     */
+  }
+  return relname_entry;
+}
+
+/**
+ * Caches relation info and tells whether accesses to it should be recorded.
+ * Temporary tables get fresh relids in every session and would only crowd
+ * relaccesses out, so depending on gp_relaccess_stats.temp_tables they are
+ * either skipped or all recorded under TEMP_TABLES_RELID.
+ */
+static bool track_relation(Oid *relid) {
+  relnameCacheEntry *entry = update_relname_cache(*relid, NULL);
+  if (entry == NULL) {
+    return false;
+  }
+  if (entry->relpersistence != RELPERSISTENCE_TEMP ||
+      temp_tables == TEMP_TABLES_TRACK) {
+    return true;
+  }
+  if (temp_tables == TEMP_TABLES_SKIP) {
+    return false;
+  }
+  *relid = TEMP_TABLES_RELID;
+  update_relname_cache(TEMP_TABLES_RELID, TEMP_TABLES_RELNAME);
+  return true;
+}
+
+/**
+ * Session attributes hardly ever change within a transaction, so the dimension
+ * value is resolved once, while we can still look up the catalog.
+ */
+static void resolve_dimension(void) {
+  const char *value = NULL;
+  xact_dimension = dimension;
+  switch (xact_dimension) {
+  case DIMENSION_APPLICATION_NAME:
+    value = application_name;
+    break;
+  case DIMENSION_RESOURCE_GROUP: {
+    Oid groupid = GetMyResGroupId();
+    value = OidIsValid(groupid) ? GetResGroupNameForId(groupid) : NULL;
+    break;
+  }
+  case DIMENSION_CLIENT_ADDR:
+    value = MyProcPort ? MyProcPort->remote_host : NULL;
+    break;
+  default:
+    return;
+  }
+  strlcpy(xact_dimension_value, value ? value : "",
+          sizeof(xact_dimension_value));
+  xact_dimension_hash = dimension_hash(xact_dimension, xact_dimension_value);
+}
+
+static localAccessEntry *memorize_local_access_entry(Oid relid, AclMode perms,
+                                                      TimestampTz ts,
+                                                      bool counted) {
+  if (n_local_accesses == 0) {
+    resolve_dimension();
+  }
+  if (n_local_accesses == local_accesses_capacity) {
+    if (local_accesses == NULL) {
+      local_accesses_capacity = LOCAL_ACCESSES_SZ;
+      local_accesses = MemoryContextAlloc(
+          TopMemoryContext, sizeof(localAccessEntry) * local_accesses_capacity);
+    } else {
+      local_accesses_capacity *= 2;
+      local_accesses = repalloc(
+          local_accesses, sizeof(localAccessEntry) * local_accesses_capacity);
+    }
+  }
+  localAccessEntry *entry = &local_accesses[n_local_accesses++];
+  entry->relid = relid;
+  entry->stmt_cnt = stmt_counter;
+  entry->perms = perms;
+  entry->user_id = GetUserId();
+  entry->ts = ts;
+  entry->counted = counted;
+  entry->nested = nesting_level > 0 && nested_accesses == NESTED_SEPARATE;
+  entry->viewid = InvalidOid;
+  entry->aborted_at = 0;
+  return entry;
+}
+
+/**
+ * Must be called right after the access entry of the refresh is memorized.
+ */
+static void remember_refresh(Oid relid, int64 time_ms, int64 rows) {
+  if (n_local_refreshes == local_refreshes_capacity) {
+    if (local_refreshes == NULL) {
+      local_refreshes_capacity = LOCAL_REFRESHES_SZ;
+      local_refreshes = MemoryContextAlloc(
+          TopMemoryContext, sizeof(localRefresh) * local_refreshes_capacity);
+    } else {
+      local_refreshes_capacity *= 2;
+      local_refreshes = repalloc(
+          local_refreshes, sizeof(localRefresh) * local_refreshes_capacity);
+    }
+  }
+  localRefresh *refresh = &local_refreshes[n_local_refreshes++];
+  refresh->relid = relid;
+  refresh->access = n_local_accesses - 1;
+  refresh->time_ms = time_ms;
+  refresh->rows = rows;
+}
+
+static void reset_local_accesses(void) {
+  n_local_accesses = 0;
+  // don't hold on to memory after a huge transaction
+  if (local_accesses_capacity > LOCAL_ACCESSES_SZ * 64) {
+    pfree(local_accesses);
+    local_accesses = NULL;
+    local_accesses_capacity = 0;
+  }
+  CLEAR_HTAB(relnameCacheEntry, relname_cache, relid);
+}
+
+/**
+ * Called when a top level statement finishes. The statement that aborts a
+ * transaction never gets here, so it is the only one left running at abort.
+ */
+static void remember_statement_end(void) {
+  if (!track_aborted || n_local_accesses == 0) {
+    return;
+  }
+  if (n_stmt_ends > 0 && stmt_ends[n_stmt_ends - 1].last == n_local_accesses) {
+    return;
+  }
+  if (n_stmt_ends == stmt_ends_capacity) {
+    if (stmt_ends == NULL) {
+      stmt_ends_capacity = STMT_ENDS_SZ;
+      stmt_ends = MemoryContextAlloc(TopMemoryContext,
+                                     sizeof(stmtEnd) * stmt_ends_capacity);
+    } else {
+      stmt_ends_capacity *= 2;
+      stmt_ends = repalloc(stmt_ends, sizeof(stmtEnd) * stmt_ends_capacity);
+    }
+  }
+  stmt_ends[n_stmt_ends].last = n_local_accesses;
+  stmt_ends[n_stmt_ends].end = GetCurrentTimestamp();
+  n_stmt_ends++;
+}
+
+/**
+ * Aborted statements are timed as aborted_at - ts. Accesses of statements
+ * that finished before the abort are moved forward by the time the
+ * transaction spent after them, so that only execution time gets counted and
+ * not the idle time in between. Must be called before local_accesses are
+ * sorted.
+ */
+static void shift_aborted_accesses(TimestampTz aborted_at) {
+  int first = 0;
+  int i, j;
+  for (i = 0; i < n_stmt_ends; i++) {
+    TimestampTz shift = aborted_at - stmt_ends[i].end;
+    for (j = first; j < stmt_ends[i].last && j < n_local_accesses; j++) {
+      // rolled back to a savepoint before, and timed back then
+      if (local_accesses[j].aborted_at == 0) {
+        local_accesses[j].ts += shift;
+      }
+    }
+    first = stmt_ends[i].last;
+  }
+}
+
+/**
+ * Keeps accesses of a subtransaction being rolled back, i.e. statements rolled
+ * back to a savepoint or caught by an exception block, to be counted as
+ * aborted ones. Their statements are timed until the rollback, the same way
+ * shift_aborted_accesses() does for a whole transaction. Accesses to relations
+ * the subtransaction created are cut off, as those relations are gone.
+ * Must be called before stmt_ends and created_relations of the subtransaction
+ * are cut off.
+ */
+static void keep_aborted_accesses(int offset, SubTransactionId mySubid) {
+  TimestampTz aborted_at = GetCurrentTimestamp();
+  int first_created = n_created_relations;
+  int first = 0;
+  int n = offset;
+  int i, j;
+  for (i = 0; i < n_stmt_ends; i++) {
+    TimestampTz shift = aborted_at - stmt_ends[i].end;
+    for (j = Max(first, offset); j < stmt_ends[i].last && j < n_local_accesses;
+         j++) {
+      if (local_accesses[j].aborted_at == 0) {
+        local_accesses[j].ts += shift;
+      }
+    }
+    first = stmt_ends[i].last;
+  }
+  // the aborted one and its children were started after its parent
+  while (first_created > 0 &&
+         created_relations[first_created - 1].subid >= mySubid) {
+    first_created--;
+  }
+  for (j = offset; j < n_local_accesses; j++) {
+    localAccessEntry *entry = &local_accesses[j];
+    for (i = first_created; i < n_created_relations; i++) {
+      if (created_relations[i].relid == entry->relid) {
+        break;
+      }
+    }
+    if (i < n_created_relations) {
+      continue;
+    }
+    if (entry->aborted_at == 0) {
+      entry->aborted_at = aborted_at;
+    }
+    local_accesses[n++] = *entry;
+  }
+  n_local_accesses = n;
+  n_created_relations = first_created;
+}
+
+static bool created_in_xact(Oid relid) {
+  return n_created_relations > 0 &&
+         bsearch(&relid, created_relations, n_created_relations,
+                 sizeof(xactRelation), relid_cmp) != NULL;
+}
+
+/**
+ * Range table entries of partitions (and other inheritance children) have no
+ * requiredPerms, so collect_relaccess_hook only sees the root. Here we look at
+ * the plan to find partitions that survived pruning and were actually scanned.
+ * Each of them is merged as an entry of its own, which is why this is off by
+ * default.
+ */
+static void memorize_partition_access(Index rti, List *rtable, AclMode perms,
+                                      TimestampTz ts) {
+  if (rti == 0 || rti > list_length(rtable)) {
+    return;
+  }
+  RangeTblEntry *rte = rt_fetch(rti, rtable);
+  if (rte->rtekind != RTE_RELATION || rte->requiredPerms != 0) {
+    // either not a relation or collect_relaccess_hook counted it already
+    return;
+  }
+  Oid relid = rte->relid;
+  if (track_relation(&relid)) {
+    memorize_local_access_entry(relid, perms, ts, false);
+  }
+}
+
+static void record_plan_partitions(Plan *plan, List *rtable, TimestampTz ts) {
+  ListCell *l;
+  if (plan == NULL) {
+    return;
+  }
+  switch (nodeTag(plan)) {
+  case T_SeqScan:
+  case T_ExternalScan:
+  case T_IndexScan:
+  case T_IndexOnlyScan:
+  case T_BitmapHeapScan:
+  case T_TidScan:
+    memorize_partition_access(((Scan *)plan)->scanrelid, rtable, ACL_SELECT,
+                              ts);
+    break;
+  case T_PartitionSelector: {
+    // partitions chosen by ORCA at plan time. Dynamic selection happens on
+    // segments, where the dynamic scans run, and is invisible to us even at
+    // ExecutorEnd, so such partitions are not recorded
+    PartitionSelector *selector = (PartitionSelector *)plan;
+    if (selector->staticSelection) {
+      foreach (l, selector->staticPartOids) {
+        Oid relid = lfirst_oid(l);
+        if (track_relation(&relid)) {
+          memorize_local_access_entry(relid, ACL_SELECT, ts, false);
+        }
+      }
+    }
+    break;
+  }
+  case T_ModifyTable: {
+    ModifyTable *mt = (ModifyTable *)plan;
+    // inserts are routed to partitions on segments, so we can't see them
+    if (mt->operation == CMD_UPDATE || mt->operation == CMD_DELETE) {
+      AclMode perms = mt->operation == CMD_UPDATE ? ACL_UPDATE : ACL_DELETE;
+      foreach (l, mt->resultRelations) {
+        memorize_partition_access(lfirst_int(l), rtable, perms, ts);
+      }
+    }
+    foreach (l, mt->plans) {
+      record_plan_partitions(lfirst(l), rtable, ts);
+    }
+    break;
+  }
+  case T_Append:
+    foreach (l, ((Append *)plan)->appendplans) {
+      record_plan_partitions(lfirst(l), rtable, ts);
+    }
+    break;
+  case T_MergeAppend:
+    foreach (l, ((MergeAppend *)plan)->mergeplans) {
+      record_plan_partitions(lfirst(l), rtable, ts);
+    }
+    break;
+  case T_Sequence:
+    foreach (l, ((Sequence *)plan)->subplans) {
+      record_plan_partitions(lfirst(l), rtable, ts);
+    }
+    break;
+  case T_SubqueryScan:
+    record_plan_partitions(((SubqueryScan *)plan)->subplan, rtable, ts);
+    break;
+  default:
+    break;
+  }
+  record_plan_partitions(plan->lefttree, rtable, ts);
+  record_plan_partitions(plan->righttree, rtable, ts);
+}
+
+static void record_scanned_partitions(PlannedStmt *stmt) {
+  ListCell *l;
+  TimestampTz curts = GetCurrentTimestamp();
+  record_plan_partitions(stmt->planTree, stmt->rtable, curts);
+  foreach (l, stmt->subplans) {
+    record_plan_partitions(lfirst(l), stmt->rtable, curts);
+  }
+}
+
+/**
+ * Sequences never make it to the range table, nextval('seq') and friends only
+ * leave a regclass constant, which the planner adds to relationOids. Much like
+ * other relations, a statement counts as one use, however many values it takes.
+ * relationOids also lists every relation of the range table, partitions
+ * included, so those are skipped w/o a lookup, and the rest only get into
+ * relname_cache if they turn out to be sequences.
+ */
+static void record_used_sequences(PlannedStmt *stmt) {
+  ListCell *l;
+  TimestampTz curts = 0;
+  int n_rtable_relids = 0;
+  Oid *rtable_relids;
+  if (stmt->relationOids == NIL) {
+    return;
+  }
+  rtable_relids = palloc(sizeof(Oid) * (list_length(stmt->rtable) + 1));
+  foreach (l, stmt->rtable) {
+    RangeTblEntry *rte = (RangeTblEntry *)lfirst(l);
+    if (rte->rtekind == RTE_RELATION) {
+      rtable_relids[n_rtable_relids++] = rte->relid;
+    }
+  }
+  qsort(rtable_relids, n_rtable_relids, sizeof(Oid), relid_cmp);
+  foreach (l, stmt->relationOids) {
+    Oid relid = lfirst_oid(l);
+    if (bsearch(&relid, rtable_relids, n_rtable_relids, sizeof(Oid),
+                relid_cmp) != NULL ||
+        get_rel_relkind(relid) != RELKIND_SEQUENCE ||
+        !track_relation(&relid)) {
+      continue;
+    }
+    if (curts == 0) {
+      curts = GetCurrentTimestamp();
+    }
+    memorize_local_access_entry(relid, ACL_USAGE, curts, true);
+  }
+  pfree(rtable_relids);
+}
+
+/**
+ * Statements started while another one runs or finishes come from functions
+ * and triggers (referential integrity checks are AFTER triggers fired by
+ * ExecutorFinish), so nesting_level tells them apart from top level ones
+ */
+static void relaccess_executor_run_hook(QueryDesc *query_desc,
+                                        ScanDirection direction, long count) {
+  relaccess_dump_if_requested();
+  nesting_level++;
+  PG_TRY();
+  {
+    if (prev_ExecutorRun_hook) {
+      prev_ExecutorRun_hook(query_desc, direction, count);
+    } else {
+      standard_ExecutorRun(query_desc, direction, count);
+    }
+  }
+  PG_CATCH();
+  {
+    nesting_level--;
+    PG_RE_THROW();
+  }
+  PG_END_TRY();
+  nesting_level--;
+}
+
+static void relaccess_executor_finish_hook(QueryDesc *query_desc) {
+  nesting_level++;
+  PG_TRY();
+  {
+    if (prev_ExecutorFinish_hook) {
+      prev_ExecutorFinish_hook(query_desc);
+    } else {
+      standard_ExecutorFinish(query_desc);
+    }
+  }
+  PG_CATCH();
+  {
+    nesting_level--;
+    PG_RE_THROW();
+  }
+  PG_END_TRY();
+  nesting_level--;
+}
+
+static void relaccess_executor_end_hook(QueryDesc *query_desc) {
+  if (Gp_role == GP_ROLE_DISPATCH && is_enabled && !skip_nested_access() &&
+      !is_session_excluded() && query_desc->plannedstmt &&
+      !(query_desc->estate->es_top_eflags & EXEC_FLAG_EXPLAIN_ONLY)) {
+    if (track_partition_scans) {
+      record_scanned_partitions(query_desc->plannedstmt);
+    }
+    record_used_sequences(query_desc->plannedstmt);
+  }
+  if (refresh_nesting_level == nesting_level && query_desc->estate) {
+    refresh_processed += query_desc->estate->es_processed;
+  }
+  if (prev_ExecutorEnd_hook) {
+    prev_ExecutorEnd_hook(query_desc);
+  } else {
+    standard_ExecutorEnd(query_desc);
+  }
+  // Unfortunately, we cannot safely rely on gp_command_counter as
+  // it is being incremented more than once for many statements.
+  // So we have to maintain our own statement counter.
+  stmt_counter++;
+  if (nesting_level == 0) {
+    remember_statement_end();
+  }
+}
+
+static StringInfoData get_dump_filename(Oid dbid) {
+  StringInfoData filename;
   initStringInfoOfSize(&filename, 256);
   appendStringInfo(&filename, "%s/relaccess_stats_dump_%d.csv",
                    PGSTAT_STAT_PERMANENT_DIRECTORY, dbid);
   return filename;
 }
 
-static void relaccess_drop_hook(ObjectAccessType access, Oid classId,
-                                Oid objectId, int subId, void *arg) {
-  if (prev_object_access_hook) {
-    prev_object_access_hook(access, classId, objectId, subId, arg);
+/**
+ * Returns all entries of a dump file as a list of palloc'ed relaccessEntry,
+ * converting them from the 1.0 format if needed. Missing file is not an error.
+ */
+static List *read_dump_file(const char *filename) {
+  List *entries = NIL;
+  relaccessDumpHeader header;
+  FILE *dump = AllocateFile(filename, "rb");
+  if (!dump) {
+    return NIL;
+  }
+  bool legacy = fread(&header, sizeof(header), 1, dump) != 1 ||
+                header.magic != RELACCESS_DUMP_MAGIC;
+  if (legacy) {
+    rewind(dump);
+  } else if (header.entry_size != sizeof(relaccessEntry)) {
+    FreeFile(dump);
+    ereport(WARNING,
+            (errmsg("gp_relaccess_stats file \"%s\" has unknown format, "
+                    "ignoring it",
+                    filename)));
+    return NIL;
+  }
+  while (true) {
+    relaccessEntry *entry = palloc0(sizeof(relaccessEntry));
+    if (legacy) {
+      relaccessEntryV1 old_entry;
+      if (fread(&old_entry, sizeof(relaccessEntryV1), 1, dump) != 1) {
+        pfree(entry);
+        break;
+      }
+      memcpy(entry, &old_entry, sizeof(relaccessEntryV1));
+    } else if (fread(entry, sizeof(relaccessEntry), 1, dump) != 1) {
+      pfree(entry);
+      break;
+    }
+    entries = lappend(entries, entry);
+  }
+  FreeFile(dump);
+  return entries;
+}
+
+/**
+ * Must be called with relaccess_file_lock held exclusively. Opens a dump file
+ * to append relaccessEntry records, writing the header to a new file. A file
+ * left by version 1.0 is rewritten in the current format first, so that
+ * records of different formats never get mixed.
+ */
+static FILE *open_dump_file_for_append(const char *filename) {
+  relaccessDumpHeader header;
+  FILE *dump = AllocateFile(filename, "rb");
+  if (dump) {
+    bool legacy = fread(&header, sizeof(header), 1, dump) == 1 &&
+                  header.magic != RELACCESS_DUMP_MAGIC;
+    FreeFile(dump);
+    if (legacy) {
+      List *entries = read_dump_file(filename);
+      ListCell *cell;
+      unlink(filename);
+      dump = open_dump_file_for_append(filename);
+      if (!dump) {
+        return NULL;
+      }
+      foreach (cell, entries) {
+        if (fwrite(lfirst(cell), sizeof(relaccessEntry), 1, dump) != 1) {
+          ereport(WARNING,
+                  (errcode_for_file_access(),
+                   errmsg("could not write gp_relaccess_stats file \"%s\": %m",
+                          filename)));
+          break;
+        }
+      }
+      list_free_deep(entries);
+      return dump;
+    }
+  }
+  dump = AllocateFile(filename, "ab");
+  if (dump && fseek(dump, 0, SEEK_END) == 0 && ftell(dump) == 0) {
+    header.magic = RELACCESS_DUMP_MAGIC;
+    header.entry_size = sizeof(relaccessEntry);
+    if (fwrite(&header, sizeof(header), 1, dump) != 1) {
+      FreeFile(dump);
+      unlink(filename);
+      ereport(WARNING,
+              (errcode_for_file_access(),
+               errmsg("could not write gp_relaccess_stats file \"%s\": %m",
+                      filename)));
+      return NULL;
+    }
+  }
+  return dump;
+}
+
+static void relaccess_drop_hook(ObjectAccessType access, Oid classId,
+                                Oid objectId, int subId, void *arg) {
+  if (prev_object_access_hook) {
+    prev_object_access_hook(access, classId, objectId, subId, arg);
+  }
+  // we don't want shared memory and .csv files hanging around forever
+  // for databases that we've dropped.
+  // This function cleans up both files and shmem
+  if (classId == DatabaseRelationId && access == OAT_DROP) {
+    relaccess_forget_database(objectId);
+  }
+  // accesses to relations created by aborted (sub)transactions are not merged
+  if (classId == RelationRelationId && access == OAT_POST_CREATE &&
+      subId == 0 && Gp_role == GP_ROLE_DISPATCH && is_enabled &&
+      track_aborted) {
+    if (n_created_relations == created_relations_capacity) {
+      if (created_relations == NULL) {
+        created_relations_capacity = CREATED_RELATIONS_SZ;
+        created_relations = MemoryContextAlloc(
+            TopMemoryContext,
+            sizeof(xactRelation) * created_relations_capacity);
+      } else {
+        created_relations_capacity *= 2;
+        created_relations =
+            repalloc(created_relations,
+                     sizeof(xactRelation) * created_relations_capacity);
+      }
+    }
+    created_relations[n_created_relations].relid = objectId;
+    created_relations[n_created_relations].subid =
+        GetCurrentSubTransactionId();
+    n_created_relations++;
+  }
+  // keep the access time index and rates from accumulating dropped relations
+  if (classId == RelationRelationId && access == OAT_DROP && subId == 0 &&
+      Gp_role == GP_ROLE_DISPATCH &&
+      (relaccess_time_slots || relaccess_rates)) {
+    if (n_dropped_relations == dropped_relations_capacity) {
+      if (dropped_relations == NULL) {
+        dropped_relations_capacity = DROPPED_RELATIONS_SZ;
+        dropped_relations = MemoryContextAlloc(
+            TopMemoryContext,
+            sizeof(xactRelation) * dropped_relations_capacity);
+      } else {
+        dropped_relations_capacity *= 2;
+        dropped_relations =
+            repalloc(dropped_relations,
+                     sizeof(xactRelation) * dropped_relations_capacity);
+      }
+    }
+    dropped_relations[n_dropped_relations].relid = objectId;
+    dropped_relations[n_dropped_relations].subid =
+        GetCurrentSubTransactionId();
+    n_dropped_relations++;
+  }
+}
+
+/**
+ * Called on commit of a transaction that dropped relations. Entries of
+ * relaccesses are left alone, as they still have to be upserted.
+ */
+static void forget_dropped_relations(void) {
+  relaccessHashKey key;
+  int i;
+  key.dbid = MyDatabaseId;
+  relaccess_lock_acquire(data->relaccess_ht_lock, LW_EXCLUSIVE);
+  for (i = 0; i < n_dropped_relations; i++) {
+    key.relid = dropped_relations[i].relid;
+    if (relaccess_time_slots) {
+      relaccessTimeSlot *slot_entry =
+          hash_search(relaccess_time_slots, &key, HASH_FIND, NULL);
+      if (slot_entry) {
+        remove_time_slot(slot_entry);
+      }
+    }
+    if (relaccess_rates) {
+      relaccessRateEntry *rate_entry =
+          hash_search(relaccess_rates, &key, HASH_FIND, NULL);
+      if (rate_entry) {
+        remove_rate_entry(rate_entry);
+      }
+    }
+    if (relaccess_hitters) {
+      relaccessHitterEntry *hitter =
+          hash_search(relaccess_hitters, &key, HASH_FIND, NULL);
+      if (hitter) {
+        remove_hitter(hitter);
+      }
+    }
+  }
+  if (relaccess_top) {
+    top_refill();
+  }
+  LWLockRelease(data->relaccess_ht_lock);
+}
+
+/**
+ * Must be called with relaccess_ht_lock held exclusively. Removes entries of
+ * dbid, or all entries if it is InvalidOid, from a shared hashtable keyed by
+ * dbid first. Entries that are also kept in heaps are removed by remove.
+ */
+static void remove_shared_entries(HTAB *htab, Oid dbid,
+                                  void (*remove)(void *entry)) {
+  HASH_SEQ_STATUS hash_seq;
+  void *entry;
+  hash_seq_init(&hash_seq, htab);
+  while ((entry = hash_seq_search(&hash_seq)) != NULL) {
+    if (OidIsValid(dbid) && *(Oid *)entry != dbid) {
+      continue;
+    }
+    if (remove) {
+      remove(entry);
+    } else {
+      hash_search(htab, entry, HASH_REMOVE, NULL);
+    }
+  }
+}
+
+// empties a shared hashtable, unless it is disabled, i.e. NULL
+static void reset_shared_entries(HTAB *htab, void (*remove)(void *entry)) {
+  if (htab) {
+    relaccess_lock_acquire(data->relaccess_ht_lock, LW_EXCLUSIVE);
+    remove_shared_entries(htab, InvalidOid, remove);
+    LWLockRelease(data->relaccess_ht_lock);
+  }
+}
+
+static void relaccess_forget_database(Oid dbid) {
+  relaccess_lock_acquire(data->relaccess_ht_lock, LW_EXCLUSIVE);
+  HASH_SEQ_STATUS hash_seq;
+  relaccessEntry *entry;
+  hash_seq_init(&hash_seq, relaccesses);
+  while ((entry = hash_seq_search(&hash_seq)) != NULL) {
+    if (entry->key.dbid == dbid) {
+      bool found;
+      hash_search(relaccesses, &entry->key, HASH_REMOVE, &found);
+      data->overflow_reported = false;
+    }
+  }
+  hash_search(relaccess_lost, &dbid, HASH_REMOVE, NULL);
+  if (relaccess_rates) {
+    remove_shared_entries(relaccess_rates, dbid, remove_rate_entry);
+    if (relaccess_top) {
+      top_refill();
+    }
+  }
+  if (relaccess_time_slots) {
+    remove_shared_entries(relaccess_time_slots, dbid, remove_time_slot);
+  }
+  if (relaccess_view_links) {
+    remove_shared_entries(relaccess_view_links, dbid, NULL);
+  }
+  if (relaccess_dims) {
+    remove_shared_entries(relaccess_dims, dbid, remove_dim_entry);
+  }
+  if (relaccess_hitters) {
+    remove_shared_entries(relaccess_hitters, dbid, remove_hitter);
+  }
+  LWLockRelease(data->relaccess_ht_lock);
+  relaccess_lock_acquire(data->relaccess_file_lock, LW_EXCLUSIVE);
+  StringInfoData filename = get_dump_filename(dbid);
+  unlink(filename.data);
+  pfree(filename.data);
+  LWLockRelease(data->relaccess_file_lock);
+}
+/**
+ * LWLockAcquire wrapper which counts acquisitions of our locks and measures the
+ * time spent waiting for them. The uncontended case costs a single conditional
+ * acquire, we only read the clock when we actually have to wait.
+ */
+static void relaccess_lock_acquire(LWLock *lock, LWLockMode mode) {
+  bool is_file_lock = (lock == data->relaccess_file_lock);
+  if (!LWLockConditionalAcquire(lock, mode)) {
+    instr_time start, duration;
+    relaccessPhase prev_phase = set_phase(
+        is_file_lock ? PHASE_FILE_LOCK_WAIT : PHASE_HT_LOCK_WAIT);
+    INSTR_TIME_SET_CURRENT(start);
+    LWLockAcquire(lock, mode);
+    set_phase(prev_phase);
+    INSTR_TIME_SET_CURRENT(duration);
+    INSTR_TIME_SUBTRACT(duration, start);
+    if (is_file_lock) {
+      LOCAL_STAT_ADD(file_lock_waits, 1);
+      LOCAL_STAT_ADD(file_lock_wait_us, INSTR_TIME_GET_MICROSEC(duration));
+    } else {
+      LOCAL_STAT_ADD(ht_lock_waits, 1);
+      LOCAL_STAT_ADD(ht_lock_wait_us, INSTR_TIME_GET_MICROSEC(duration));
+    }
+  }
+  if (is_file_lock) {
+    LOCAL_STAT_ADD(file_lock_acquires, 1);
+  } else {
+    LOCAL_STAT_ADD(ht_lock_acquires, 1);
+  }
+}
+
+static void record_latency(relaccessLatencyKind kind, instr_time duration) {
+  uint64 us = INSTR_TIME_GET_MICROSEC(duration);
+  int bucket = 0;
+  while (us > 0 && bucket < LATENCY_BUCKETS - 1) {
+    us >>= 1;
+    bucket++;
+  }
+  local_latency[kind].buckets[bucket]++;
+  local_stats_dirty = true;
+}
+
+static void flush_internal_stats() {
+  volatile relaccessGlobalData *shared = data;
+  int i, j;
+  if (!shared) {
+    return;
+  }
+  SpinLockAcquire(&shared->stats_lock);
+  for (i = 0; i < lengthof(internal_stat_names); i++) {
+    Size offset = internal_stat_names[i].offset;
+    *(volatile int64 *)((volatile char *)&shared->stats + offset) +=
+        *(int64 *)((char *)&local_stats + offset);
+  }
+  for (i = 0; i < LATENCY_KINDS; i++) {
+    for (j = 0; j < LATENCY_BUCKETS; j++) {
+      shared->latency[i].buckets[j] += local_latency[i].buckets[j];
+    }
+  }
+  SpinLockRelease(&shared->stats_lock);
+  memset(&local_stats, 0, sizeof(local_stats));
+  memset(local_latency, 0, sizeof(local_latency));
+  local_stats_dirty = false;
+}
+
+Datum relaccess_stats_internal(PG_FUNCTION_ARGS) {
+  FuncCallContext *funcctx;
+  relaccessInternalStats *snapshot;
+
+  if (SRF_IS_FIRSTCALL()) {
+    volatile relaccessGlobalData *shared = data;
+    funcctx = SRF_FIRSTCALL_INIT();
+    MemoryContext oldcontext =
+        MemoryContextSwitchTo(funcctx->multi_call_memory_ctx);
+    TupleDesc tupdesc = CreateTemplateTupleDesc(2, false /* hasoid */);
+    TupleDescInitEntry(tupdesc, (AttrNumber)1, "name", TEXTOID, -1 /* typmod */,
+                       0 /* attdim */);
+    TupleDescInitEntry(tupdesc, (AttrNumber)2, "value", INT8OID,
+                       -1 /* typmod */, 0 /* attdim */);
+    funcctx->tuple_desc = BlessTupleDesc(tupdesc);
+    // make our own pending counters visible to ourselves
+    flush_internal_stats();
+    snapshot = palloc(sizeof(relaccessInternalStats));
+    SpinLockAcquire(&shared->stats_lock);
+    memcpy(snapshot, (relaccessInternalStats *)&shared->stats,
+           sizeof(relaccessInternalStats));
+    SpinLockRelease(&shared->stats_lock);
+    funcctx->user_fctx = snapshot;
+    funcctx->max_calls = lengthof(internal_stat_names);
+    MemoryContextSwitchTo(oldcontext);
+  }
+
+  funcctx = SRF_PERCALL_SETUP();
+  snapshot = (relaccessInternalStats *)funcctx->user_fctx;
+  if (funcctx->call_cntr < funcctx->max_calls) {
+    Datum values[2];
+    bool nulls[2];
+    MemSet(nulls, 0, sizeof(nulls));
+    values[0] =
+        CStringGetTextDatum(internal_stat_names[funcctx->call_cntr].name);
+    values[1] = Int64GetDatum(*(int64 *)((char *)snapshot +
+                                         internal_stat_names[funcctx->call_cntr]
+                                             .offset));
+    HeapTuple tuple = heap_form_tuple(funcctx->tuple_desc, values, nulls);
+    SRF_RETURN_NEXT(funcctx, HeapTupleGetDatum(tuple));
+  }
+  SRF_RETURN_DONE(funcctx);
+}
+
+Datum relaccess_stats_latency(PG_FUNCTION_ARGS) {
+  FuncCallContext *funcctx;
+  relaccessLatencyHistogram *snapshot;
+
+  if (SRF_IS_FIRSTCALL()) {
+    volatile relaccessGlobalData *shared = data;
+    funcctx = SRF_FIRSTCALL_INIT();
+    MemoryContext oldcontext =
+        MemoryContextSwitchTo(funcctx->multi_call_memory_ctx);
+    TupleDesc tupdesc = CreateTemplateTupleDesc(3, false /* hasoid */);
+    TupleDescInitEntry(tupdesc, (AttrNumber)1, "histogram", TEXTOID,
+                       -1 /* typmod */, 0 /* attdim */);
+    TupleDescInitEntry(tupdesc, (AttrNumber)2, "bucket_upper_us", INT8OID,
+                       -1 /* typmod */, 0 /* attdim */);
+    TupleDescInitEntry(tupdesc, (AttrNumber)3, "count", INT8OID,
+                       -1 /* typmod */, 0 /* attdim */);
+    funcctx->tuple_desc = BlessTupleDesc(tupdesc);
+    flush_internal_stats();
+    snapshot = palloc(sizeof(relaccessLatencyHistogram) * LATENCY_KINDS);
+    SpinLockAcquire(&shared->stats_lock);
+    memcpy(snapshot, (relaccessLatencyHistogram *)shared->latency,
+           sizeof(relaccessLatencyHistogram) * LATENCY_KINDS);
+    SpinLockRelease(&shared->stats_lock);
+    funcctx->user_fctx = snapshot;
+    funcctx->max_calls = LATENCY_KINDS * LATENCY_BUCKETS;
+    MemoryContextSwitchTo(oldcontext);
   }
-  // we don't want shared memory and .csv files hanging around forever
-  // for databases that we've dropped.
-  // This function cleans up both files and shmem
-  if (classId == DatabaseRelationId && access == OAT_DROP) {
-    LWLockAcquire(data->relaccess_ht_lock, LW_EXCLUSIVE);
+
+  funcctx = SRF_PERCALL_SETUP();
+  snapshot = (relaccessLatencyHistogram *)funcctx->user_fctx;
+  while (funcctx->call_cntr < funcctx->max_calls) {
+    int kind = funcctx->call_cntr / LATENCY_BUCKETS;
+    int bucket = funcctx->call_cntr % LATENCY_BUCKETS;
+    Datum values[3];
+    bool nulls[3];
+    if (snapshot[kind].buckets[bucket] == 0) {
+      // only report non-empty buckets
+      funcctx->call_cntr++;
+      continue;
+    }
+    MemSet(nulls, 0, sizeof(nulls));
+    values[0] = CStringGetTextDatum(latency_kind_names[kind]);
+    values[1] = Int64GetDatum(INT64CONST(1) << bucket);
+    values[2] = Int64GetDatum(snapshot[kind].buckets[bucket]);
+    HeapTuple tuple = heap_form_tuple(funcctx->tuple_desc, values, nulls);
+    SRF_RETURN_NEXT(funcctx, HeapTupleGetDatum(tuple));
+  }
+  SRF_RETURN_DONE(funcctx);
+}
+
+Datum relaccess_stats_latency_reset(PG_FUNCTION_ARGS) {
+  volatile relaccessGlobalData *shared = data;
+  memset(local_latency, 0, sizeof(local_latency));
+  SpinLockAcquire(&shared->stats_lock);
+  memset((relaccessLatencyHistogram *)shared->latency, 0,
+         sizeof(relaccessLatencyHistogram) * LATENCY_KINDS);
+  SpinLockRelease(&shared->stats_lock);
+  PG_RETURN_VOID();
+}
+
+/**
+ * Must be called with relaccess_ht_lock held exclusively. If we track lost
+ * events for too many databases, the rest is accounted under InvalidOid.
+ */
+static void account_lost_event(Oid dbid) {
+  bool found;
+  relaccessLostEntry *entry =
+      hash_search(relaccess_lost, &dbid, HASH_ENTER_NULL, &found);
+  if (!entry) {
+    dbid = InvalidOid;
+    entry = hash_search(relaccess_lost, &dbid, HASH_ENTER_NULL, &found);
+    if (!entry) {
+      // all slots are taken by real databases
+      LOCAL_STAT_ADD(dropped_entries, 1);
+      return;
+    }
+  }
+  if (!found) {
+    entry->dbid = dbid;
+    entry->n_lost = 0;
+  }
+  entry->n_lost++;
+  entry->last_lost = GetCurrentTimestamp();
+  LOCAL_STAT_ADD(dropped_entries, 1);
+}
+
+Datum relaccess_stats_lost(PG_FUNCTION_ARGS) {
+  FuncCallContext *funcctx;
+  relaccessLostEntry *snapshot;
+
+  if (SRF_IS_FIRSTCALL()) {
     HASH_SEQ_STATUS hash_seq;
-    relaccessEntry *entry;
-    hash_seq_init(&hash_seq, relaccesses);
+    relaccessLostEntry *entry;
+    int n = 0;
+    funcctx = SRF_FIRSTCALL_INIT();
+    MemoryContext oldcontext =
+        MemoryContextSwitchTo(funcctx->multi_call_memory_ctx);
+    TupleDesc tupdesc = CreateTemplateTupleDesc(3, false /* hasoid */);
+    TupleDescInitEntry(tupdesc, (AttrNumber)1, "dbid", OIDOID, -1 /* typmod */,
+                       0 /* attdim */);
+    TupleDescInitEntry(tupdesc, (AttrNumber)2, "n_lost_events", INT8OID,
+                       -1 /* typmod */, 0 /* attdim */);
+    TupleDescInitEntry(tupdesc, (AttrNumber)3, "last_lost", TIMESTAMPTZOID,
+                       -1 /* typmod */, 0 /* attdim */);
+    funcctx->tuple_desc = BlessTupleDesc(tupdesc);
+    snapshot = palloc(sizeof(relaccessLostEntry) * LOST_HTAB_SZ);
+    relaccess_lock_acquire(data->relaccess_ht_lock, LW_SHARED);
+    hash_seq_init(&hash_seq, relaccess_lost);
     while ((entry = hash_seq_search(&hash_seq)) != NULL) {
-      if (entry->key.dbid == objectId) {
-        bool found;
-        hash_search(relaccesses, &entry->key, HASH_REMOVE, &found);
-        had_ht_overflow = false;
+      Assert(n < LOST_HTAB_SZ);
+      snapshot[n++] = *entry;
+    }
+    LWLockRelease(data->relaccess_ht_lock);
+    funcctx->user_fctx = snapshot;
+    funcctx->max_calls = n;
+    MemoryContextSwitchTo(oldcontext);
+  }
+
+  funcctx = SRF_PERCALL_SETUP();
+  snapshot = (relaccessLostEntry *)funcctx->user_fctx;
+  if (funcctx->call_cntr < funcctx->max_calls) {
+    relaccessLostEntry *entry = &snapshot[funcctx->call_cntr];
+    Datum values[3];
+    bool nulls[3];
+    MemSet(nulls, 0, sizeof(nulls));
+    values[0] = ObjectIdGetDatum(entry->dbid);
+    values[1] = Int64GetDatum(entry->n_lost);
+    values[2] = TimestampTzGetDatum(entry->last_lost);
+    HeapTuple tuple = heap_form_tuple(funcctx->tuple_desc, values, nulls);
+    SRF_RETURN_NEXT(funcctx, HeapTupleGetDatum(tuple));
+  }
+  SRF_RETURN_DONE(funcctx);
+}
+
+/**
+ * First call setup of a set returning function whose rows are built by
+ * srf_next_row()
+ */
+static FuncCallContext *srf_first_call(FunctionCallInfo fcinfo,
+                                       const srfColumn *columns,
+                                       int n_columns) {
+  int i;
+  FuncCallContext *funcctx = SRF_FIRSTCALL_INIT();
+  MemoryContext oldcontext =
+      MemoryContextSwitchTo(funcctx->multi_call_memory_ctx);
+  Assert(n_columns <= SRF_MAX_COLUMNS);
+  TupleDesc tupdesc = CreateTemplateTupleDesc(n_columns, false /* hasoid */);
+  for (i = 0; i < n_columns; i++) {
+    TupleDescInitEntry(tupdesc, (AttrNumber)(i + 1), columns[i].name,
+                       columns[i].type, -1 /* typmod */, 0 /* attdim */);
+  }
+  funcctx->tuple_desc = BlessTupleDesc(tupdesc);
+  funcctx->user_fctx = NULL;
+  funcctx->max_calls = 0;
+  MemoryContextSwitchTo(oldcontext);
+  return funcctx;
+}
+
+/**
+ * Must be called with relaccess_ht_lock held. Copies all entries of a shared
+ * hashtable into the current memory context.
+ */
+static void *snapshot_htab(HTAB *htab, Size entrysize, int *n) {
+  HASH_SEQ_STATUS hash_seq;
+  void *entry;
+  char *snapshot = palloc(entrysize * (hash_get_num_entries(htab) + 1));
+  *n = 0;
+  hash_seq_init(&hash_seq, htab);
+  while ((entry = hash_seq_search(&hash_seq)) != NULL) {
+    memcpy(snapshot + entrysize * (*n)++, entry, entrysize);
+  }
+  return snapshot;
+}
+
+/**
+ * Returns the next row of a set returning function, whose first call left
+ * max_calls entries of entrysize bytes in user_fctx
+ */
+static Datum srf_next_row(FunctionCallInfo fcinfo, Size entrysize,
+                          srfFillRow fill) {
+  FuncCallContext *funcctx = SRF_PERCALL_SETUP();
+  if (funcctx->call_cntr < funcctx->max_calls) {
+    Datum values[SRF_MAX_COLUMNS];
+    bool nulls[SRF_MAX_COLUMNS];
+    MemSet(nulls, 0, sizeof(nulls));
+    fill((char *)funcctx->user_fctx + entrysize * funcctx->call_cntr, values,
+         nulls);
+    HeapTuple tuple = heap_form_tuple(funcctx->tuple_desc, values, nulls);
+    SRF_RETURN_NEXT(funcctx, HeapTupleGetDatum(tuple));
+  }
+  SRF_RETURN_DONE(funcctx);
+}
+
+static const srfColumn dimension_columns[] = {
+    {"dbid", OIDOID},
+    {"relid", OIDOID},
+    {"dimension_type", TEXTOID},
+    {"dimension", TEXTOID},
+    {"n_reads", INT8OID},
+    {"n_writes", INT8OID},
+    {"max_overcount", INT8OID},
+    {"last_access", TIMESTAMPTZOID},
+};
+
+static void dimension_row(void *entry, Datum *values, bool *nulls) {
+  static const char *const dimension_names[] = {
+      "none", "application_name", "resource_group", "client_addr"};
+  relaccessDimEntry *dim_entry = (relaccessDimEntry *)entry;
+  values[0] = ObjectIdGetDatum(dim_entry->key.dbid);
+  values[1] = ObjectIdGetDatum(dim_entry->key.relid);
+  values[2] = CStringGetTextDatum(dimension_names[dim_entry->key.kind]);
+  values[3] = CStringGetTextDatum(dim_entry->key.value);
+  values[4] = Int64GetDatum(dim_entry->n_reads);
+  values[5] = Int64GetDatum(dim_entry->n_writes);
+  values[6] = Int64GetDatum(dim_entry->overcount);
+  values[7] = TimestampTzGetDatum(dim_entry->last_access);
+}
+
+Datum relaccess_stats_dimensions(PG_FUNCTION_ARGS) {
+  if (SRF_IS_FIRSTCALL()) {
+    FuncCallContext *funcctx = srf_first_call(
+        fcinfo, dimension_columns, lengthof(dimension_columns));
+    if (relaccess_dims) {
+      int n;
+      MemoryContext oldcontext =
+          MemoryContextSwitchTo(funcctx->multi_call_memory_ctx);
+      relaccess_lock_acquire(data->relaccess_ht_lock, LW_SHARED);
+      funcctx->user_fctx =
+          snapshot_htab(relaccess_dims, sizeof(relaccessDimEntry), &n);
+      LWLockRelease(data->relaccess_ht_lock);
+      funcctx->max_calls = n;
+      MemoryContextSwitchTo(oldcontext);
+    }
+  }
+  return srf_next_row(fcinfo, sizeof(relaccessDimEntry), dimension_row);
+}
+
+Datum relaccess_stats_dimensions_reset(PG_FUNCTION_ARGS) {
+  reset_shared_entries(relaccess_dims, remove_dim_entry);
+  PG_RETURN_VOID();
+}
+
+static const srfColumn rate_columns[] = {
+    {"dbid", OIDOID},
+    {"relid", OIDOID},
+    {"reads_per_sec", FLOAT8OID},
+    {"writes_per_sec", FLOAT8OID},
+    {"last_access", TIMESTAMPTZOID},
+};
+
+static void rate_row(void *entry, Datum *values, bool *nulls) {
+  relaccessRateEntry *rate_entry = (relaccessRateEntry *)entry;
+  values[0] = ObjectIdGetDatum(rate_entry->key.dbid);
+  values[1] = ObjectIdGetDatum(rate_entry->key.relid);
+  values[2] = Float8GetDatum(rate_entry->read_rate);
+  values[3] = Float8GetDatum(rate_entry->write_rate);
+  values[4] = TimestampTzGetDatum(rate_entry->last_update);
+}
+
+// all rates are decayed to the same moment to be comparable
+static void decay_rates(relaccessRateEntry *snapshot, int n) {
+  TimestampTz now = GetCurrentTimestamp();
+  int i;
+  for (i = 0; i < n; i++) {
+    snapshot[i].read_rate =
+        decay_rate(snapshot[i].read_rate, snapshot[i].last_update, now);
+    snapshot[i].write_rate =
+        decay_rate(snapshot[i].write_rate, snapshot[i].last_update, now);
+  }
+}
+
+Datum relaccess_stats_rates(PG_FUNCTION_ARGS) {
+  if (SRF_IS_FIRSTCALL()) {
+    FuncCallContext *funcctx =
+        srf_first_call(fcinfo, rate_columns, lengthof(rate_columns));
+    if (relaccess_rates) {
+      int n;
+      MemoryContext oldcontext =
+          MemoryContextSwitchTo(funcctx->multi_call_memory_ctx);
+      relaccess_lock_acquire(data->relaccess_ht_lock, LW_SHARED);
+      relaccessRateEntry *snapshot =
+          snapshot_htab(relaccess_rates, sizeof(relaccessRateEntry), &n);
+      LWLockRelease(data->relaccess_ht_lock);
+      decay_rates(snapshot, n);
+      funcctx->user_fctx = snapshot;
+      funcctx->max_calls = n;
+      MemoryContextSwitchTo(oldcontext);
+    }
+  }
+  return srf_next_row(fcinfo, sizeof(relaccessRateEntry), rate_row);
+}
+
+Datum relaccess_stats_rates_reset(PG_FUNCTION_ARGS) {
+  reset_shared_entries(relaccess_rates, remove_rate_entry);
+  PG_RETURN_VOID();
+}
+
+static int rate_entry_cmp(const void *a, const void *b) {
+  const relaccessRateEntry *e1 = (const relaccessRateEntry *)a;
+  const relaccessRateEntry *e2 = (const relaccessRateEntry *)b;
+  double r1 = e1->read_rate + e1->write_rate;
+  double r2 = e2->read_rate + e2->write_rate;
+  if (r1 != r2) {
+    return r1 > r2 ? -1 : 1;
+  }
+  return 0;
+}
+
+/**
+ * Same as relaccess_stats_rates(), but only returns the hottest relations,
+ * hottest first. Costs O(top_size) regardless of how many rates are tracked.
+ */
+Datum relaccess_stats_top(PG_FUNCTION_ARGS) {
+  if (SRF_IS_FIRSTCALL()) {
+    FuncCallContext *funcctx =
+        srf_first_call(fcinfo, rate_columns, lengthof(rate_columns));
+    if (relaccess_top) {
+      int n;
+      MemoryContext oldcontext =
+          MemoryContextSwitchTo(funcctx->multi_call_memory_ctx);
+      relaccessRateEntry *snapshot =
+          palloc(sizeof(relaccessRateEntry) * top_size);
+      relaccess_lock_acquire(data->relaccess_ht_lock, LW_SHARED);
+      for (n = 0; n < relaccess_top->n; n++) {
+        snapshot[n] = *(relaccessRateEntry *)relaccess_top->items[n].entry;
+      }
+      LWLockRelease(data->relaccess_ht_lock);
+      decay_rates(snapshot, n);
+      qsort(snapshot, n, sizeof(relaccessRateEntry), rate_entry_cmp);
+      funcctx->user_fctx = snapshot;
+      funcctx->max_calls = n;
+      MemoryContextSwitchTo(oldcontext);
+    }
+  }
+  return srf_next_row(fcinfo, sizeof(relaccessRateEntry), rate_row);
+}
+
+// the number of slots relaccess_stats_cold() checks in one go
+#define COLD_SCAN_BLOCK 256
+
+/**
+ * GCC only vectorizes at -O3 before version 12, so the loop asks for it. On
+ * x86-64, which has no 64-bit vector comparisons before SSE4.2, GCC 6 and
+ * later also build an AVX2 clone picked at run time. Clang vectorizes at -O2.
+ */
+#if defined(__GNUC__) && !defined(__clang__) && defined(__x86_64__) &&        \
+    __GNUC__ >= 6
+#define COLD_SCAN_TARGETS                                                      \
+  __attribute__((optimize("tree-vectorize"),                                   \
+                 target_clones("avx2", "default")))
+#elif defined(__GNUC__) && !defined(__clang__)
+#define COLD_SCAN_TARGETS __attribute__((optimize("tree-vectorize")))
+#else
+#define COLD_SCAN_TARGETS
+#endif
+
+/**
+ * Marks slots of a full block not accessed since before. A constant trip
+ * count and no branches make the loop easy to vectorize.
+ */
+static COLD_SCAN_TARGETS void mark_cold_block(const TimestampTz *reads,
+                                              const TimestampTz *writes,
+                                              TimestampTz before, bool *cold) {
+  int i;
+  for (i = 0; i < COLD_SCAN_BLOCK; i++) {
+    cold[i] = (reads[i] < before) & (writes[i] < before);
+  }
+}
+
+/**
+ * Returns relations of the current database of the kinds relaccess_stats is
+ * seeded with, temporary ones aside
+ */
+static Oid *list_database_relations(int *n) {
+  int capacity = 1024;
+  Oid *relids = palloc(sizeof(Oid) * capacity);
+  Relation rel = heap_open(RelationRelationId, AccessShareLock);
+  HeapScanDesc scan = heap_beginscan_catalog(rel, 0, NULL);
+  HeapTuple tuple;
+  *n = 0;
+  while ((tuple = heap_getnext(scan, ForwardScanDirection)) != NULL) {
+    Form_pg_class reltup = (Form_pg_class)GETSTRUCT(tuple);
+    if ((reltup->relkind != RELKIND_RELATION &&
+         reltup->relkind != RELKIND_VIEW &&
+         reltup->relkind != RELKIND_MATVIEW &&
+         reltup->relkind != RELKIND_FOREIGN_TABLE &&
+         reltup->relkind != RELKIND_SEQUENCE) ||
+        reltup->relpersistence == RELPERSISTENCE_TEMP) {
+      continue;
+    }
+    if (*n == capacity) {
+      capacity *= 2;
+      relids = repalloc(relids, sizeof(Oid) * capacity);
+    }
+    relids[(*n)++] = HeapTupleGetOid(tuple);
+  }
+  heap_endscan(scan);
+  heap_close(rel, AccessShareLock);
+  return relids;
+}
+
+static const srfColumn cold_columns[] = {
+    {"dbid", OIDOID},
+    {"relid", OIDOID},
+    {"last_read", TIMESTAMPTZOID},
+    {"last_write", TIMESTAMPTZOID},
+};
+
+static void cold_row(void *entry, Datum *values, bool *nulls) {
+  coldRelation *cold_entry = (coldRelation *)entry;
+  values[0] = ObjectIdGetDatum(cold_entry->key.dbid);
+  values[1] = ObjectIdGetDatum(cold_entry->key.relid);
+  // zero means no read or write since the index start
+  values[2] = TimestampTzGetDatum(cold_entry->last_read);
+  values[3] = TimestampTzGetDatum(cold_entry->last_write);
+  nulls[2] = cold_entry->last_read == 0;
+  nulls[3] = cold_entry->last_write == 0;
+}
+
+/**
+ * Returns relations indexed in the access time index that were neither read
+ * nor written since the given moment. Each block is first marked by
+ * mark_cold_block(), then only the matches are visited. Relations of the
+ * current database missing from the index are returned with NULL timestamps,
+ * provided the index knows they were not accessed since the given moment.
+ */
+Datum relaccess_stats_cold(PG_FUNCTION_ARGS) {
+  if (SRF_IS_FIRSTCALL()) {
+    TimestampTz before = PG_GETARG_TIMESTAMPTZ(0);
+    FuncCallContext *funcctx =
+        srf_first_call(fcinfo, cold_columns, lengthof(cold_columns));
+    if (relaccess_time_slots) {
+      bool cold[COLD_SCAN_BLOCK];
+      int start, i;
+      int n = 0;
+      int n_relations;
+      MemoryContext oldcontext =
+          MemoryContextSwitchTo(funcctx->multi_call_memory_ctx);
+      Oid *relations = list_database_relations(&n_relations);
+      relaccess_lock_acquire(data->relaccess_ht_lock, LW_SHARED);
+      int n_slots = *time_slots_used;
+      int *matches = palloc(sizeof(int) * (n_slots + 1));
+      for (start = 0; start < n_slots; start += COLD_SCAN_BLOCK) {
+        int n_block = Min(COLD_SCAN_BLOCK, n_slots - start);
+        const TimestampTz *reads = time_slot_last_read + start;
+        const TimestampTz *writes = time_slot_last_write + start;
+        if (n_block == COLD_SCAN_BLOCK) {
+          mark_cold_block(reads, writes, before, cold);
+        } else {
+          for (i = 0; i < n_block; i++) {
+            cold[i] = reads[i] < before && writes[i] < before;
+          }
+        }
+        for (i = 0; i < n_block; i++) {
+          if (cold[i]) {
+            matches[n++] = start + i;
+          }
+        }
       }
+      // the index may change as soon as we release the lock
+      coldRelation *snapshot =
+          palloc(sizeof(coldRelation) * (n + n_relations + 1));
+      for (i = 0; i < n; i++) {
+        snapshot[i].key.dbid = time_slot_dbid[matches[i]];
+        snapshot[i].key.relid = time_slot_relid[matches[i]];
+        snapshot[i].last_read = time_slot_last_read[matches[i]];
+        snapshot[i].last_write = time_slot_last_write[matches[i]];
+      }
+      if (before >= *time_index_since) {
+        relaccessHashKey key;
+        key.dbid = MyDatabaseId;
+        for (i = 0; i < n_relations; i++) {
+          key.relid = relations[i];
+          if (!hash_search(relaccess_time_slots, &key, HASH_FIND, NULL)) {
+            snapshot[n].key = key;
+            snapshot[n].last_read = 0;
+            snapshot[n].last_write = 0;
+            n++;
+          }
+        }
+      }
+      LWLockRelease(data->relaccess_ht_lock);
+      pfree(matches);
+      pfree(relations);
+      funcctx->user_fctx = snapshot;
+      funcctx->max_calls = n;
+      MemoryContextSwitchTo(oldcontext);
+    }
+  }
+  return srf_next_row(fcinfo, sizeof(coldRelation), cold_row);
+}
+
+Datum relaccess_stats_cold_reset(PG_FUNCTION_ARGS) {
+  if (relaccess_time_slots) {
+    relaccess_lock_acquire(data->relaccess_ht_lock, LW_EXCLUSIVE);
+    remove_shared_entries(relaccess_time_slots, InvalidOid, remove_time_slot);
+    *time_index_since = GetCurrentTimestamp();
+    LWLockRelease(data->relaccess_ht_lock);
+  }
+  PG_RETURN_VOID();
+}
+
+static const srfColumn sketch_estimate_columns[] = {
+    {"n_select_queries", INT8OID},
+    {"n_insert_queries", INT8OID},
+    {"n_update_queries", INT8OID},
+    {"n_delete_queries", INT8OID},
+    {"n_truncate_queries", INT8OID},
+};
+
+/**
+ * Estimates queries to a relation of the current database that were counted
+ * by the sketch rather than relaccesses. Like any Count-Min sketch, it never
+ * underestimates, and overestimates by about e / sketch_width of all sketched
+ * queries of a kind with probability 1 - exp(-sketch_depth).
+ */
+Datum relaccess_stats_sketch_estimate(PG_FUNCTION_ARGS) {
+  relaccessHashKey key;
+  int i;
+  Datum values[lengthof(sketch_estimate_columns)];
+  bool nulls[lengthof(sketch_estimate_columns)];
+  TupleDesc tupdesc = CreateTemplateTupleDesc(lengthof(sketch_estimate_columns),
+                                              false /* hasoid */);
+  for (i = 0; i < lengthof(sketch_estimate_columns); i++) {
+    TupleDescInitEntry(tupdesc, (AttrNumber)(i + 1),
+                       sketch_estimate_columns[i].name,
+                       sketch_estimate_columns[i].type, -1 /* typmod */,
+                       0 /* attdim */);
+    nulls[i] = relaccess_sketch == NULL;
+  }
+  tupdesc = BlessTupleDesc(tupdesc);
+  if (relaccess_sketch) {
+    relaccessSketchCell estimate;
+    key.dbid = MyDatabaseId;
+    key.relid = PG_GETARG_OID(0);
+    uint32 hashvalue = get_hash_value(relaccesses, &key);
+    relaccess_lock_acquire(data->relaccess_ht_lock, LW_SHARED);
+    sketch_estimate(hashvalue, &estimate);
+    LWLockRelease(data->relaccess_ht_lock);
+    values[0] = Int64GetDatum(estimate.n_select);
+    values[1] = Int64GetDatum(estimate.n_insert);
+    values[2] = Int64GetDatum(estimate.n_update);
+    values[3] = Int64GetDatum(estimate.n_delete);
+    values[4] = Int64GetDatum(estimate.n_truncate);
+  }
+  PG_RETURN_DATUM(HeapTupleGetDatum(heap_form_tuple(tupdesc, values, nulls)));
+}
+
+Datum relaccess_stats_sketch_reset(PG_FUNCTION_ARGS) {
+  if (relaccess_sketch) {
+    relaccess_lock_acquire(data->relaccess_ht_lock, LW_EXCLUSIVE);
+    memset(relaccess_sketch, 0, relaccess_sketch_size());
+    if (relaccess_hitters) {
+      remove_shared_entries(relaccess_hitters, InvalidOid, remove_hitter);
     }
     LWLockRelease(data->relaccess_ht_lock);
-    LWLockAcquire(data->relaccess_file_lock, LW_EXCLUSIVE);
-    StringInfoData filename = get_dump_filename(objectId);
-    unlink(filename.data);
-    pfree(filename.data);
+  }
+  PG_RETURN_VOID();
+}
+
+static int hitter_cmp(const void *a, const void *b) {
+  const relaccessHitterEntry *e1 = (const relaccessHitterEntry *)a;
+  const relaccessHitterEntry *e2 = (const relaccessHitterEntry *)b;
+  int64 n1 = e1->n_reads + e1->n_writes;
+  int64 n2 = e2->n_reads + e2->n_writes;
+  if (n1 != n2) {
+    return n1 > n2 ? -1 : 1;
+  }
+  return 0;
+}
+
+static const srfColumn hitter_columns[] = {
+    {"dbid", OIDOID},
+    {"relid", OIDOID},
+    {"relname", TEXTOID},
+    {"n_reads", INT8OID},
+    {"n_writes", INT8OID},
+    {"last_reader_id", OIDOID},
+    {"last_writer_id", OIDOID},
+    {"last_read", TIMESTAMPTZOID},
+    {"last_write", TIMESTAMPTZOID},
+};
+
+static void hitter_row(void *entry, Datum *values, bool *nulls) {
+  relaccessHitterEntry *hitter = (relaccessHitterEntry *)entry;
+  values[0] = ObjectIdGetDatum(hitter->key.dbid);
+  values[1] = ObjectIdGetDatum(hitter->key.relid);
+  values[2] = CStringGetTextDatum(hitter->relname);
+  values[3] = Int64GetDatum(hitter->n_reads);
+  values[4] = Int64GetDatum(hitter->n_writes);
+  values[5] = ObjectIdGetDatum(hitter->last_reader_id);
+  values[6] = ObjectIdGetDatum(hitter->last_writer_id);
+  values[7] = TimestampTzGetDatum(hitter->last_read);
+  values[8] = TimestampTzGetDatum(hitter->last_write);
+  nulls[2] = hitter->relname[0] == '\0';
+  // zero means no read or write since the relation became a heavy hitter
+  nulls[5] = !OidIsValid(hitter->last_reader_id);
+  nulls[6] = !OidIsValid(hitter->last_writer_id);
+  nulls[7] = hitter->last_read == 0;
+  nulls[8] = hitter->last_write == 0;
+}
+
+/**
+ * Returns sketched relations with the highest estimates, highest first, see
+ * relaccessHitterEntry
+ */
+Datum relaccess_stats_sketch_hitters(PG_FUNCTION_ARGS) {
+  if (SRF_IS_FIRSTCALL()) {
+    FuncCallContext *funcctx =
+        srf_first_call(fcinfo, hitter_columns, lengthof(hitter_columns));
+    if (relaccess_hitters) {
+      int n;
+      MemoryContext oldcontext =
+          MemoryContextSwitchTo(funcctx->multi_call_memory_ctx);
+      relaccess_lock_acquire(data->relaccess_ht_lock, LW_SHARED);
+      relaccessHitterEntry *snapshot =
+          snapshot_htab(relaccess_hitters, sizeof(relaccessHitterEntry), &n);
+      LWLockRelease(data->relaccess_ht_lock);
+      qsort(snapshot, n, sizeof(relaccessHitterEntry), hitter_cmp);
+      funcctx->user_fctx = snapshot;
+      funcctx->max_calls = n;
+      MemoryContextSwitchTo(oldcontext);
+    }
+  }
+  return srf_next_row(fcinfo, sizeof(relaccessHitterEntry), hitter_row);
+}
+
+static const srfColumn view_link_columns[] = {
+    {"dbid", OIDOID},
+    {"viewid", OIDOID},
+    {"relid", OIDOID},
+    {"n_queries", INT8OID},
+    {"last_access", TIMESTAMPTZOID},
+};
+
+static void view_link_row(void *entry, Datum *values, bool *nulls) {
+  relaccessViewLinkEntry *link = (relaccessViewLinkEntry *)entry;
+  values[0] = ObjectIdGetDatum(link->key.dbid);
+  values[1] = ObjectIdGetDatum(link->key.viewid);
+  values[2] = ObjectIdGetDatum(link->key.relid);
+  values[3] = Int64GetDatum(link->n_queries);
+  values[4] = TimestampTzGetDatum(link->last_access);
+}
+
+Datum relaccess_stats_view_links(PG_FUNCTION_ARGS) {
+  if (SRF_IS_FIRSTCALL()) {
+    FuncCallContext *funcctx = srf_first_call(
+        fcinfo, view_link_columns, lengthof(view_link_columns));
+    if (relaccess_view_links) {
+      int n;
+      MemoryContext oldcontext =
+          MemoryContextSwitchTo(funcctx->multi_call_memory_ctx);
+      relaccess_lock_acquire(data->relaccess_ht_lock, LW_SHARED);
+      funcctx->user_fctx = snapshot_htab(
+          relaccess_view_links, sizeof(relaccessViewLinkEntry), &n);
+      LWLockRelease(data->relaccess_ht_lock);
+      funcctx->max_calls = n;
+      MemoryContextSwitchTo(oldcontext);
+    }
+  }
+  return srf_next_row(fcinfo, sizeof(relaccessViewLinkEntry), view_link_row);
+}
+
+Datum relaccess_stats_view_links_reset(PG_FUNCTION_ARGS) {
+  reset_shared_entries(relaccess_view_links, NULL);
+  PG_RETURN_VOID();
+}
+
+/**
+ * Benchmark helper, not part of the extension API. It is created by
+ * test/bench/merge_setup.sql. Simulates n_xacts transactions, each touching
+ * rels_per_xact relations picked from rel_universe synthetic relids. With
+ * skew = 1 relations are picked uniformly, higher values make low relids
+ * hotter. If do_merge is false we only pay for recording accesses locally,
+ * which gives the baseline to compare the commit path against.
+ * Synthetic stats are merged into private hashtables of the same size as the
+ * shared ones under the real relaccess_ht_lock, so that lock contention is
+ * measured while shared stats are never touched. Optional structures (rates,
+ * dimensions, time index, sketch) and dumps are off for the duration, and
+ * internal stats gathered meanwhile are discarded.
+ */
+Datum relaccess_bench_merge(PG_FUNCTION_ARGS) {
+  int32 n_xacts = PG_GETARG_INT32(0);
+  int32 rels_per_xact = PG_GETARG_INT32(1);
+  int32 rel_universe = PG_GETARG_INT32(2);
+  double skew = PG_GETARG_FLOAT8(3);
+  bool do_merge = PG_GETARG_BOOL(4);
+  relaccessInternalStats stats_before = local_stats;
+  relaccessInternalStats stats_after;
+  relaccessLatencyHistogram latency_before[LATENCY_KINDS];
+  bool stats_dirty_before = local_stats_dirty;
+  HTAB *shared_relaccesses = relaccesses;
+  HTAB *shared_lost = relaccess_lost;
+  HTAB *shared_dims = relaccess_dims;
+  HTAB *shared_view_links = relaccess_view_links;
+  HTAB *shared_rates = relaccess_rates;
+  HTAB *shared_time_slots = relaccess_time_slots;
+  relaccessSketchCell *shared_sketch = relaccess_sketch;
+  bool shared_dump_on_overflow = dump_on_overflow;
+  int shared_dump_horizon = dump_horizon;
+  instr_time start, duration;
+  int32 xact, rel;
+  volatile bool failed = false;
+  HASHCTL info;
+
+  if (n_xacts <= 0 || rels_per_xact <= 0 || rel_universe <= 0 || skew <= 0) {
+    ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                    errmsg("all benchmark arguments must be positive")));
+  }
+  if (n_local_accesses > 0) {
+    ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+                    errmsg("benchmark must not share a transaction with "
+                           "tracked statements")));
+  }
+  memcpy(latency_before, local_latency, sizeof(latency_before));
+  memset(&info, 0, sizeof(info));
+  info.keysize = sizeof(relaccessHashKey);
+  info.entrysize = sizeof(relaccessEntry);
+  info.hash = relaccess_hash_fn;
+  info.match = relaccess_match_fn;
+  info.hcxt = CurrentMemoryContext;
+  HTAB *private_relaccesses =
+      hash_create("relaccess_bench hash", relaccess_size, &info,
+                  (HASH_ELEM | HASH_FUNCTION | HASH_COMPARE | HASH_CONTEXT));
+  memset(&info, 0, sizeof(info));
+  info.keysize = sizeof(Oid);
+  info.entrysize = sizeof(relaccessLostEntry);
+  info.hash = oid_hash;
+  info.hcxt = CurrentMemoryContext;
+  HTAB *private_lost =
+      hash_create("relaccess_bench lost events", LOST_HTAB_SZ, &info,
+                  (HASH_ELEM | HASH_FUNCTION | HASH_CONTEXT));
+
+  bench_private = true;
+  relaccesses = private_relaccesses;
+  relaccess_lost = private_lost;
+  relaccess_dims = NULL;
+  relaccess_view_links = NULL;
+  relaccess_rates = NULL;
+  relaccess_time_slots = NULL;
+  relaccess_sketch = NULL;
+  dump_on_overflow = false;
+  dump_horizon = 0;
+  PG_TRY();
+  {
+    INSTR_TIME_SET_CURRENT(start);
+    for (xact = 0; xact < n_xacts; xact++) {
+      TimestampTz curts = GetCurrentTimestamp();
+      for (rel = 0; rel < rels_per_xact; rel++) {
+        double u = (double)random() / ((double)MAX_RANDOM_VALUE + 1);
+        Oid relid = FirstNormalObjectId + (Oid)(rel_universe * pow(u, skew));
+        memorize_local_access_entry(
+            relid, (rel % 4) ? ACL_SELECT : ACL_INSERT, curts, true);
+        update_relname_cache(relid, "relaccess_bench");
+      }
+      if (do_merge) {
+        relaccess_merge_local_entries(InvalidOid, 0);
+      }
+      reset_local_accesses();
+      stmt_counter++;
+      CHECK_FOR_INTERRUPTS();
+    }
+    INSTR_TIME_SET_CURRENT(duration);
+    INSTR_TIME_SUBTRACT(duration, start);
+  }
+  PG_CATCH();
+  {
+    reset_local_accesses();
+    failed = true;
+  }
+  PG_END_TRY();
+  bench_private = false;
+  relaccesses = shared_relaccesses;
+  relaccess_lost = shared_lost;
+  relaccess_dims = shared_dims;
+  relaccess_view_links = shared_view_links;
+  relaccess_rates = shared_rates;
+  relaccess_time_slots = shared_time_slots;
+  relaccess_sketch = shared_sketch;
+  dump_on_overflow = shared_dump_on_overflow;
+  dump_horizon = shared_dump_horizon;
+  if (failed) {
+    PG_RE_THROW();
+  }
+  hash_destroy(private_relaccesses);
+  hash_destroy(private_lost);
+  // synthetic merges must not show up in relaccess_stats_internal()
+  stats_after = local_stats;
+  local_stats = stats_before;
+  memcpy(local_latency, latency_before, sizeof(latency_before));
+  local_stats_dirty = stats_dirty_before;
+
+  TupleDesc tupdesc = CreateTemplateTupleDesc(5, false /* hasoid */);
+  TupleDescInitEntry(tupdesc, (AttrNumber)1, "xacts", INT8OID, -1 /* typmod */,
+                     0 /* attdim */);
+  TupleDescInitEntry(tupdesc, (AttrNumber)2, "elapsed_ms", FLOAT8OID,
+                     -1 /* typmod */, 0 /* attdim */);
+  TupleDescInitEntry(tupdesc, (AttrNumber)3, "xacts_per_sec", FLOAT8OID,
+                     -1 /* typmod */, 0 /* attdim */);
+  TupleDescInitEntry(tupdesc, (AttrNumber)4, "lock_waits", INT8OID,
+                     -1 /* typmod */, 0 /* attdim */);
+  TupleDescInitEntry(tupdesc, (AttrNumber)5, "lock_wait_us", INT8OID,
+                     -1 /* typmod */, 0 /* attdim */);
+  tupdesc = BlessTupleDesc(tupdesc);
+  Datum values[5];
+  bool nulls[5];
+  double elapsed_ms = INSTR_TIME_GET_MILLISEC(duration);
+  MemSet(nulls, 0, sizeof(nulls));
+  values[0] = Int64GetDatum(n_xacts);
+  values[1] = Float8GetDatum(elapsed_ms);
+  values[2] = Float8GetDatum(elapsed_ms > 0 ? n_xacts * 1000.0 / elapsed_ms
+                                            : 0);
+  values[3] =
+      Int64GetDatum(stats_after.ht_lock_waits - stats_before.ht_lock_waits);
+  values[4] =
+      Int64GetDatum(stats_after.ht_lock_wait_us - stats_before.ht_lock_wait_us);
+  PG_RETURN_DATUM(HeapTupleGetDatum(heap_form_tuple(tupdesc, values, nulls)));
+}
+
+/**
+ * Benchmark helper, not part of the extension API. It is created by
+ * bench/scale_setup.sql. Appends n_entries synthetic stats for relids
+ * first_relid, first_relid + 1, ... to this database's dump file, the same
+ * way relaccess_dump_to_files() does, so that relaccess_stats_update() can be
+ * timed at any table count without running that many queries.
+ */
+Datum relaccess_bench_write_dump(PG_FUNCTION_ARGS) {
+  int32 n_entries = PG_GETARG_INT32(0);
+  Oid first_relid = PG_GETARG_OID(1);
+  TimestampTz now = GetCurrentTimestamp();
+  relaccessEntry entry;
+  int32 i;
+
+  if (n_entries <= 0) {
+    ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                    errmsg("number of entries must be positive")));
+  }
+  MemSet(&entry, 0, sizeof(entry));
+  entry.key.dbid = MyDatabaseId;
+  entry.last_reader_id = entry.last_writer_id = GetUserId();
+  entry.last_read = entry.last_write = now;
+  entry.n_select = entry.n_insert = 1;
+  StringInfoData filename = get_dump_filename(MyDatabaseId);
+  relaccess_lock_acquire(data->relaccess_file_lock, LW_EXCLUSIVE);
+  FILE *dump = open_dump_file_for_append(filename.data);
+  if (!dump) {
     LWLockRelease(data->relaccess_file_lock);
+    ereport(ERROR, (errcode_for_file_access(),
+                    errmsg("could not open gp_relaccess_stats file \"%s\": %m",
+                           filename.data)));
+  }
+  for (i = 0; i < n_entries; i++) {
+    entry.key.relid = first_relid + i;
+    snprintf(entry.relname, sizeof(entry.relname), "relaccess_bench_%u",
+             entry.key.relid);
+    if (fwrite(&entry, sizeof(relaccessEntry), 1, dump) != 1) {
+      break;
+    }
+  }
+  FreeFile(dump);
+  LWLockRelease(data->relaccess_file_lock);
+  pfree(filename.data);
+  if (i != n_entries) {
+    ereport(ERROR, (errcode_for_file_access(),
+                    errmsg("could not write gp_relaccess_stats file: %m")));
+  }
+  PG_RETURN_VOID();
+}
+
+/**
+ * Publishes what this backend is doing and returns the previous phase, so
+ * that nested phases can be restored. Readers don't take any locks, a torn
+ * read may show a stale phase for a moment, which is fine for monitoring.
+ */
+static relaccessPhase set_phase(relaccessPhase phase) {
+  relaccessPhase prev_phase = current_phase;
+  current_phase = phase;
+  if (data && MyBackendId > 0 && MyBackendId <= data->n_phase_slots) {
+    volatile relaccessBackendPhase *slot = &data->phases[MyBackendId - 1];
+    slot->phase = PHASE_NONE;
+    slot->pid = MyProcPid;
+    slot->since = phase == PHASE_NONE ? 0 : GetCurrentTimestamp();
+    slot->phase = phase;
+  }
+  return prev_phase;
+}
+
+Datum relaccess_stats_activity(PG_FUNCTION_ARGS) {
+  FuncCallContext *funcctx;
+  List *active = NIL;
+
+  if (SRF_IS_FIRSTCALL()) {
+    int i;
+    funcctx = SRF_FIRSTCALL_INIT();
+    MemoryContext oldcontext =
+        MemoryContextSwitchTo(funcctx->multi_call_memory_ctx);
+    TupleDesc tupdesc = CreateTemplateTupleDesc(3, false /* hasoid */);
+    TupleDescInitEntry(tupdesc, (AttrNumber)1, "pid", INT4OID, -1 /* typmod */,
+                       0 /* attdim */);
+    TupleDescInitEntry(tupdesc, (AttrNumber)2, "phase", TEXTOID,
+                       -1 /* typmod */, 0 /* attdim */);
+    TupleDescInitEntry(tupdesc, (AttrNumber)3, "phase_start", TIMESTAMPTZOID,
+                       -1 /* typmod */, 0 /* attdim */);
+    funcctx->tuple_desc = BlessTupleDesc(tupdesc);
+    for (i = 0; i < data->n_phase_slots; i++) {
+      volatile relaccessBackendPhase *slot = &data->phases[i];
+      relaccessBackendPhase *copy;
+      relaccessPhase phase = slot->phase;
+      if (phase == PHASE_NONE) {
+        continue;
+      }
+      copy = palloc(sizeof(relaccessBackendPhase));
+      copy->pid = slot->pid;
+      copy->since = slot->since;
+      copy->phase = phase;
+      active = lappend(active, copy);
+    }
+    funcctx->user_fctx = active;
+    MemoryContextSwitchTo(oldcontext);
+  }
+
+  funcctx = SRF_PERCALL_SETUP();
+  active = (List *)funcctx->user_fctx;
+  while (active != NIL) {
+    relaccessBackendPhase *entry = linitial(active);
+    active = list_delete_first(active);
+    funcctx->user_fctx = active;
+    Datum values[3];
+    bool nulls[3];
+    MemSet(nulls, 0, sizeof(nulls));
+    values[0] = Int32GetDatum(entry->pid);
+    values[1] = CStringGetTextDatum(phase_names[entry->phase]);
+    values[2] = TimestampTzGetDatum(entry->since);
+    HeapTuple tuple = heap_form_tuple(funcctx->tuple_desc, values, nulls);
+    SRF_RETURN_NEXT(funcctx, HeapTupleGetDatum(tuple));
   }
-}
\ No newline at end of file
+  SRF_RETURN_DONE(funcctx);
+}
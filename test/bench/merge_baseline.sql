@@ -0,0 +1,2 @@
+-- pgbench script: same workload, but nothing is merged into shared memory
+SELECT * FROM relaccess.__relaccess_bench_merge(:xacts, :rels, :universe, :skew, false);
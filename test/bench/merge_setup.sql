@@ -0,0 +1,9 @@
+-- Creates the test-only benchmark function. Run once per database:
+--   psql -d <db> -f test/bench/merge_setup.sql
+CREATE OR REPLACE FUNCTION relaccess.__relaccess_bench_merge(
+    n_xacts int, rels_per_xact int, rel_universe int, skew float8, do_merge bool,
+    OUT xacts bigint, OUT elapsed_ms float8, OUT xacts_per_sec float8,
+    OUT lock_waits bigint, OUT lock_wait_us bigint)
+RETURNS record
+AS '$libdir/gp_relaccess_stats', 'relaccess_bench_merge'
+LANGUAGE C VOLATILE EXECUTE ON MASTER;
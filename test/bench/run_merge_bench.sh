@@ -0,0 +1,62 @@
+#!/usr/bin/env bash
+# Microbenchmark of the commit merge path (relaccess_xact_callback).
+# Runs N pgbench clients, each simulating transactions that touch M relations,
+# first without merging into shared memory (baseline), then with merging.
+# Prints simulated commits per second, lock waits and commit merge latency.
+#
+# Usage: run_merge_bench.sh [-d db] [-c clients] [-T seconds] [-m rels_per_xact]
+#                           [-u rel_universe] [-s skew] [-x xacts_per_call]
+set -euo pipefail
+
+DB=${PGDATABASE:-postgres}
+CLIENTS=8
+DURATION=30
+RELS=16
+UNIVERSE=10000
+SKEW=1.0
+XACTS=100
+
+while getopts "d:c:T:m:u:s:x:" opt; do
+  case $opt in
+    d) DB=$OPTARG ;;
+    c) CLIENTS=$OPTARG ;;
+    T) DURATION=$OPTARG ;;
+    m) RELS=$OPTARG ;;
+    u) UNIVERSE=$OPTARG ;;
+    s) SKEW=$OPTARG ;;
+    x) XACTS=$OPTARG ;;
+    *) sed -n '2,9p' "$0"; exit 1 ;;
+  esac
+done
+
+HERE=$(cd "$(dirname "$0")" && pwd)
+PSQL="psql -X -q -t -A -d $DB"
+
+$PSQL -f "$HERE/merge_setup.sql"
+
+internal_stat() {
+  $PSQL -c "SELECT value FROM relaccess.relaccess_stats_internal() WHERE name = '$1'"
+}
+
+run() {
+  local script=$1
+  $PSQL -c "SELECT relaccess.relaccess_stats_latency_reset()" >/dev/null
+  local waits_before wait_us_before
+  waits_before=$(internal_stat ht_lock_waits)
+  wait_us_before=$(internal_stat ht_lock_wait_us)
+  local tps
+  tps=$(pgbench -n -c "$CLIENTS" -j "$CLIENTS" -T "$DURATION" \
+      -D xacts="$XACTS" -D rels="$RELS" -D universe="$UNIVERSE" -D skew="$SKEW" \
+      -f "$HERE/$script" "$DB" | awk '/excluding connections/ {print $3}')
+  local waits wait_us p99
+  waits=$(( $(internal_stat ht_lock_waits) - waits_before ))
+  wait_us=$(( $(internal_stat ht_lock_wait_us) - wait_us_before ))
+  p99=$($PSQL -c "SELECT coalesce(p99_us, 0) FROM relaccess.relaccess_stats_latency_summary WHERE histogram = 'commit_merge'")
+  printf "%-10s %14.0f %12d %14d %12s\n" "${script%.sql}" \
+      "$(awk -v t="$tps" -v x="$XACTS" 'BEGIN {print t * x}')" "$waits" "$wait_us" "${p99:-0}"
+}
+
+echo "clients=$CLIENTS rels_per_xact=$RELS universe=$UNIVERSE skew=$SKEW duration=${DURATION}s"
+printf "%-10s %14s %12s %14s %12s\n" "mode" "commits/s" "lock_waits" "lock_wait_us" "p99_merge_us"
+run merge_baseline.sql
+run merge.sql
@@ -10,6 +10,7 @@ DROP TABLE IF EXISTS tbl4 CASCADE;
 DROP TABLE IF EXISTS new_tbl1 CASCADE;
 DROP TABLE IF EXISTS p3_sales CASCADE;
 DROP TABLE IF EXISTS public.last_usr_checks CASCADE;
+DROP TABLE IF EXISTS savepoint_tbl CASCADE;
 DROP USER IF EXISTS select_usr;
 DROP USER IF EXISTS update_usr;
 DROP USER IF EXISTS insert_usr;
@@ -126,6 +127,37 @@ SELECT relname, n_select_queries, n_insert_queries, n_update_queries, n_delete_q
 FROM relaccess_stats WHERE relname LIKE 'p3_sales%' ORDER BY relname;
 SELECT relname, n_select_queries, n_insert_queries, n_update_queries, n_delete_queries, n_truncate_queries 
 FROM relaccess_stats_root_tables_aggregated WHERE relname LIKE 'p3_sales%' ORDER BY relname;
+-- partitions pruned by the planner are not touched, scanned ones only get last_read
+SET gp_relaccess_stats.track_partition_scans TO on;
+TRUNCATE relaccess_stats;
+SELECT count(*) FROM p3_sales WHERE year = 2003 AND month = 5 AND region = 'usa';
+SELECT relaccess_stats_update();
+SELECT count(*) > 0 AS scanned,
+    count(*) < (SELECT count(*) FROM pg_partitions WHERE tablename = 'p3_sales' AND partitionlevel = 2) AS pruned,
+    sum(n_select_queries) AS n_select_queries
+FROM relaccess_stats WHERE relname LIKE 'p3_sales_%';
+SELECT relname, n_select_queries FROM relaccess_stats_root_tables_aggregated WHERE relname = 'p3_sales';
+RESET gp_relaccess_stats.track_partition_scans;
+-- truncate w/o ONLY is counted for the root and updates last_write of all partitions
+TRUNCATE relaccess_stats;
+TRUNCATE p3_sales;
+SELECT relaccess_stats_update();
+SELECT count(*) = (SELECT count(*) FROM pg_partitions WHERE tablename = 'p3_sales') AS all_partitions,
+    sum(n_truncate_queries) AS n_truncate_queries
+FROM relaccess_stats WHERE relname LIKE 'p3_sales_%' AND last_write > last_read;
+SELECT n_truncate_queries FROM relaccess_stats WHERE relname = 'p3_sales';
+-- inheritors detached with NO INHERIT are no longer truncated with the parent
+CREATE TABLE inh_parent (a INTEGER);
+CREATE TABLE inh_child () INHERITS (inh_parent);
+TRUNCATE inh_parent;
+ALTER TABLE inh_child NO INHERIT inh_parent;
+SELECT relaccess_stats_update();
+TRUNCATE relaccess_stats;
+TRUNCATE inh_parent;
+SELECT relaccess_stats_update();
+SELECT relname, n_truncate_queries FROM relaccess_stats WHERE relname IN ('inh_parent', 'inh_child') AND last_write > last_read;
+DROP TABLE inh_child;
+DROP TABLE inh_parent;
 
 -- test last_reader and last_writer
 CREATE USER select_usr;
@@ -161,7 +193,159 @@ RESET ROLE;
 SELECT relaccess_stats_update();
 SELECT (SELECT last_writer_id FROM relaccess_stats WHERE RELNAME = 'last_usr_checks') = (SELECT oid FROM pg_roles WHERE rolname = 'truncate_usr');
 RESET ROLE;
+-- sessions of excluded roles and applications are not tracked
+SELECT n_select_queries AS selects_before FROM relaccess_stats WHERE relname = 'last_usr_checks' \gset
+SET gp_relaccess_stats.exclude_applications TO 'gpbackup*, nightly_check';
+SET application_name TO 'gpbackup_helper';
+SELECT count(*) FROM public.last_usr_checks;
+RESET application_name;
+SET gp_relaccess_stats.exclude_roles TO 'select_usr';
+SET SESSION AUTHORIZATION select_usr;
+SELECT count(*) FROM public.last_usr_checks;
+RESET SESSION AUTHORIZATION;
+RESET gp_relaccess_stats.exclude_roles;
+RESET gp_relaccess_stats.exclude_applications;
+SELECT count(*) FROM public.last_usr_checks;
+SELECT relaccess_stats_update();
+SELECT n_select_queries - :selects_before AS new_selects FROM relaccess_stats WHERE relname = 'last_usr_checks';
+
+-- check self-instrumentation counters
+SELECT name, value > 0 AS nonzero FROM relaccess_stats_internal() WHERE name IN ('hook_calls', 'entries_merged', 'dumps') ORDER BY name;
+SELECT histogram FROM relaccess_stats_latency_summary WHERE count > 0 AND p50_us <= p99_us ORDER BY histogram;
+SELECT relaccess_stats_fill_rate() >= 0 AS fill_rate_ok;
+-- statements rolled back to a savepoint are only counted as aborted
+CREATE TABLE savepoint_tbl (a integer);
+BEGIN;
+INSERT INTO savepoint_tbl VALUES (1);
+SAVEPOINT sp1;
+INSERT INTO savepoint_tbl VALUES (2);
+DELETE FROM savepoint_tbl;
+ROLLBACK TO SAVEPOINT sp1;
+SAVEPOINT sp2;
+UPDATE savepoint_tbl SET a = 3;
+RELEASE SAVEPOINT sp2;
+DO $$
+BEGIN
+  DELETE FROM savepoint_tbl;
+  PERFORM 1 / 0;
+EXCEPTION WHEN division_by_zero THEN
+  NULL;
+END $$;
+COMMIT;
+SELECT relaccess_stats_update();
+SELECT n_insert_queries, n_update_queries, n_delete_queries, n_aborted_queries FROM relaccess_stats WHERE relname = 'savepoint_tbl';
+-- DDL is tracked and table rewrites are counted separately
+ALTER TABLE savepoint_tbl ADD COLUMN b integer;
+ALTER TABLE savepoint_tbl SET WITH (REORGANIZE=true);
+CREATE INDEX savepoint_tbl_idx ON savepoint_tbl (a);
+SELECT relaccess_stats_update();
+SELECT n_ddl_queries, n_rewrite_queries FROM relaccess_stats WHERE relname = 'savepoint_tbl';
+-- statements run by functions and triggers can be counted separately or skipped
+SET gp_relaccess_stats.nested_accesses TO 'separate';
+INSERT INTO savepoint_tbl VALUES (4);
+DO $$ BEGIN INSERT INTO savepoint_tbl VALUES (5); END $$;
+SET gp_relaccess_stats.nested_accesses TO 'skip';
+DO $$ BEGIN INSERT INTO savepoint_tbl VALUES (6); END $$;
+RESET gp_relaccess_stats.nested_accesses;
+SELECT relaccess_stats_update();
+SELECT n_insert_queries, n_nested_queries FROM relaccess_stats WHERE relname = 'savepoint_tbl';
+-- temporary tables are aggregated into a single entry
+CREATE TEMP TABLE tmp_tbl1 (a integer);
+CREATE TEMP TABLE tmp_tbl2 (a integer);
+INSERT INTO tmp_tbl1 VALUES (1);
+INSERT INTO tmp_tbl2 SELECT * FROM tmp_tbl1;
+DROP TABLE tmp_tbl1, tmp_tbl2;
+SELECT relaccess_stats_update();
+SELECT count(*) FROM relaccess_stats WHERE relname IN ('tmp_tbl1', 'tmp_tbl2');
+SELECT relname, n_insert_queries >= 2 AS aggregated FROM relaccess_stats WHERE relid = 0;
+-- accesses can be broken down by a session attribute
+SET gp_relaccess_stats.dimension TO 'application_name';
+SET application_name TO 'dimension_test';
+SELECT count(*) FROM savepoint_tbl;
+RESET application_name;
+RESET gp_relaccess_stats.dimension;
+SELECT dimension_type, dimension, n_reads, n_writes FROM relaccess_stats_by_dimension WHERE relname = 'savepoint_tbl';
+-- aborted transactions are counted separately
+BEGIN;
+INSERT INTO savepoint_tbl VALUES (7);
+DELETE FROM savepoint_tbl;
+ROLLBACK;
+SELECT relaccess_stats_update();
+SELECT n_insert_queries, n_delete_queries, n_aborted_queries, last_aborted > last_write AS aborted_last, aborted_time_ms >= 0 AS time_ok
+    FROM relaccess_stats WHERE relname = 'savepoint_tbl';
+-- only execution time of aborted statements is counted, not idle time
+BEGIN;
+SELECT count(*) > 0 AS has_rows FROM savepoint_tbl;
+SELECT pg_sleep(2);
+SELECT 1 / 0;
+ROLLBACK;
+SELECT relaccess_stats_update();
+SELECT n_aborted_queries, aborted_time_ms < 2000 AS time_ok
+    FROM relaccess_stats WHERE relname = 'savepoint_tbl';
+-- relations created by an aborted transaction are not counted
+BEGIN;
+CREATE TABLE aborted_tbl (a integer);
+INSERT INTO aborted_tbl VALUES (1);
+ROLLBACK;
+SELECT relaccess_stats_update();
+SELECT count(*) FROM relaccess_stats WHERE relname = 'aborted_tbl';
+-- accesses through a view are attributed to it
+CREATE VIEW savepoint_view AS SELECT * FROM savepoint_tbl;
+SELECT count(*) FROM savepoint_view;
+SELECT count(*) FROM savepoint_view v1, savepoint_view v2;
+SELECT viewname, relname, n_queries FROM relaccess_stats_by_view WHERE viewname = 'savepoint_view';
+DROP VIEW savepoint_view;
+-- refreshes of materialized views are counted and timed
+CREATE MATERIALIZED VIEW savepoint_matview AS SELECT * FROM savepoint_tbl;
+SELECT count(*) FROM savepoint_matview;
+REFRESH MATERIALIZED VIEW savepoint_matview;
+REFRESH MATERIALIZED VIEW savepoint_matview;
+SELECT relaccess_stats_update();
+SELECT n_select_queries, n_refresh_queries, last_refresh > last_read AS refreshed_last, refresh_time_ms >= 0 AS time_ok, refresh_rows
+    FROM relaccess_stats WHERE relname = 'savepoint_matview';
+DROP MATERIALIZED VIEW savepoint_matview;
+-- queries using a sequence are counted for it
+CREATE SEQUENCE savepoint_seq;
+SELECT nextval('savepoint_seq');
+SELECT nextval('savepoint_seq'), nextval('savepoint_seq');
+SELECT relaccess_stats_update();
+SELECT n_select_queries, n_usage_queries, last_read > last_write AS used
+    FROM relaccess_stats WHERE relname = 'savepoint_seq';
+DROP SEQUENCE savepoint_seq;
+-- access rates survive dumps
+SELECT reads_per_sec > 0 AS read, writes_per_sec > 0 AS written FROM relaccess_stats_by_rate WHERE relname = 'savepoint_tbl';
+SELECT count(*) FROM relaccess_stats_by_top WHERE relname = 'savepoint_tbl';
+-- cold relations are found w/o updating stats
+SELECT count(*) FROM relaccess_stats_cold(now() + interval '1 hour') s JOIN pg_class c ON c.oid = s.relid WHERE c.relname = 'savepoint_tbl';
+SELECT count(*) FROM relaccess_stats_cold('2001-01-01') s JOIN pg_class c ON c.oid = s.relid WHERE c.relname = 'savepoint_tbl';
+-- relations never accessed are cold too, dropped ones leave the index
+CREATE TABLE cold_tbl (a integer);
+SELECT count(*), bool_and(last_read IS NULL AND last_write IS NULL) AS never FROM relaccess_stats_cold(now() + interval '1 hour') s JOIN pg_class c ON c.oid = s.relid WHERE c.relname = 'cold_tbl';
+SELECT count(*) FROM relaccess_stats_cold('2001-01-01') s JOIN pg_class c ON c.oid = s.relid WHERE c.relname = 'cold_tbl';
+INSERT INTO cold_tbl VALUES (1);
+SELECT 'cold_tbl'::regclass::oid AS cold_relid \gset
+DROP TABLE cold_tbl;
+SELECT count(*) FROM relaccess_stats_cold(now() + interval '1 hour') WHERE relid = :cold_relid;
+-- the sketch is off by default
+SELECT n_select_queries IS NULL AND n_insert_queries IS NULL AS no_sketch FROM relaccess_stats_sketch_estimate('savepoint_tbl'::regclass);
 
+-- backends are listed while busy inside the extension only
+SELECT count(*) FROM __get_backend_phases() WHERE pid = pg_backend_pid();
+CREATE TEMP TABLE activity_snapshot (phase text, datname name, usename name, busy_for interval);
+ALTER FUNCTION __relaccess_upsert_from_dump_file() RENAME TO __relaccess_upsert_from_dump_file_orig;
+CREATE FUNCTION __relaccess_upsert_from_dump_file() RETURNS VOID LANGUAGE plpgsql AS $$
+BEGIN
+    INSERT INTO activity_snapshot SELECT phase, datname, usename, phase_duration
+        FROM relaccess_stats_activity WHERE pid = pg_backend_pid();
+    PERFORM __relaccess_upsert_from_dump_file_orig();
+END $$;
+SELECT count(*) FROM savepoint_tbl;
+SELECT relaccess_stats_update();
+DROP FUNCTION __relaccess_upsert_from_dump_file();
+ALTER FUNCTION __relaccess_upsert_from_dump_file_orig() RENAME TO __relaccess_upsert_from_dump_file;
+SELECT phase, datname = current_database() AS our_db, usename = current_user AS our_user, busy_for >= interval '0' AS busy
+    FROM activity_snapshot;
+DROP TABLE activity_snapshot;
 -- make sure we can turn it OFF
 SET gp_relaccess_stats.enabled TO 'off';
 SELECT relaccess_stats_update();
@@ -178,6 +362,7 @@ DROP TABLE tbl4 CASCADE;
 DROP TABLE new_tbl1 CASCADE;
 DROP TABLE p3_sales CASCADE;
 DROP TABLE public.last_usr_checks CASCADE;
+DROP TABLE savepoint_tbl CASCADE;
 DROP USER select_usr;
 DROP USER update_usr;
 DROP USER insert_usr;
@@ -0,0 +1,112 @@
+-- max_tables overflow, predictive dumps and the sketch need settings that only
+-- take effect on restart. Everything is reset to defaults at the end.
+CREATE EXTENSION gp_relaccess_stats;
+
+-- lost events are accounted once max_tables is exceeded
+\! gpconfig -c gp_relaccess_stats.max_tables -v 128 > /dev/null
+\! gpstop -ari > /dev/null
+\c
+SET client_min_messages TO ERROR;
+SET search_path TO relaccess;
+SET gp_relaccess_stats.enabled TO 'on';
+DO $$
+BEGIN
+  FOR i IN 1..200 LOOP
+    EXECUTE 'CREATE TABLE lost_tbl_' || i || ' (a INTEGER)';
+    EXECUTE 'SELECT count(*) FROM lost_tbl_' || i;
+  END LOOP;
+END $$;
+SELECT n_lost_events > 0 AS lost, last_lost <= now() AS lost_ts FROM relaccess_stats_lost()
+    WHERE dbid = (SELECT oid FROM pg_database WHERE datname = current_database());
+-- a transaction bringing more tables than there is room for requests a dump
+\! gpconfig -c gp_relaccess_stats.dump_horizon -v 3600 > /dev/null
+\! gpstop -u > /dev/null
+SELECT pg_sleep(1);
+SHOW gp_relaccess_stats.dump_horizon;
+SELECT relaccess_stats_update();
+DO $$
+BEGIN
+  FOR i IN 1..200 LOOP
+    EXECUTE 'SELECT count(*) FROM lost_tbl_' || i;
+  END LOOP;
+END $$;
+SELECT value > 0 AS dumped FROM relaccess_stats_internal() WHERE name = 'auto_dumps';
+-- small transactions request a dump once the fill rate predicts an overflow
+CREATE TEMP TABLE auto_dumps_before AS
+    SELECT value FROM relaccess_stats_internal() WHERE name = 'auto_dumps';
+SELECT relaccess_stats_update();
+DO $$
+BEGIN
+  FOR i IN 1..20 LOOP
+    EXECUTE 'SELECT count(*) FROM lost_tbl_' || i;
+  END LOOP;
+END $$;
+SELECT pg_sleep(1.1);
+DO $$
+BEGIN
+  FOR i IN 21..60 LOOP
+    EXECUTE 'SELECT count(*) FROM lost_tbl_' || i;
+  END LOOP;
+END $$;
+SELECT relaccess_stats_fill_rate() > 0 AS filling;
+DO $$
+BEGIN
+  FOR i IN 61..70 LOOP
+    EXECUTE 'SELECT count(*) FROM lost_tbl_' || i;
+  END LOOP;
+END $$;
+SELECT a.value > b.value AS predicted
+    FROM relaccess_stats_internal() a, auto_dumps_before b
+    WHERE a.name = 'auto_dumps';
+\! gpconfig -r gp_relaccess_stats.dump_horizon > /dev/null
+DO $$
+BEGIN
+  FOR i IN 1..200 LOOP
+    EXECUTE 'DROP TABLE lost_tbl_' || i;
+  END LOOP;
+END $$;
+-- with the sketch, only heavy hitters are tracked exactly and nothing is lost
+\! gpconfig -c gp_relaccess_stats.sketch_width -v 1024 > /dev/null
+\! gpconfig -c gp_relaccess_stats.sketch_heavy_hitters -v 16 > /dev/null
+\! gpstop -ari > /dev/null
+\c
+SET client_min_messages TO ERROR;
+SET search_path TO relaccess;
+SET gp_relaccess_stats.enabled TO 'on';
+DO $$
+BEGIN
+  FOR i IN 1..200 LOOP
+    EXECUTE 'CREATE TABLE sketch_tbl_' || i || ' (a INTEGER)';
+    EXECUTE 'SELECT count(*) FROM sketch_tbl_' || i;
+  END LOOP;
+END $$;
+DO $$
+BEGIN
+  FOR i IN 1..200 LOOP
+    EXECUTE 'SELECT count(*) FROM sketch_tbl_' || i;
+  END LOOP;
+END $$;
+SELECT count(*) AS n_lost FROM relaccess_stats_lost()
+    WHERE dbid = (SELECT oid FROM pg_database WHERE datname = current_database());
+SELECT name, value FROM relaccess_stats_internal()
+    WHERE name IN ('overflows', 'dumps', 'auto_dumps') ORDER BY name;
+SELECT count(*) AS n_estimated FROM pg_class
+    WHERE relname LIKE 'sketch_tbl_%'
+    AND (relaccess_stats_sketch_estimate(oid)).n_select_queries >= 1;
+SELECT count(*) AS n_hitters, bool_and(last_read IS NOT NULL
+    AND (relaccess_stats_sketch_estimate(relid)).n_select_queries <= n_reads) AS estimated
+    FROM relaccess_stats_sketch_hitters()
+    WHERE dbid = (SELECT oid FROM pg_database WHERE datname = current_database());
+SELECT relaccess_stats_update();
+SELECT count(*) <= 16 AS hitters_only FROM relaccess_stats WHERE relname LIKE 'sketch_tbl_%';
+DO $$
+BEGIN
+  FOR i IN 1..200 LOOP
+    EXECUTE 'DROP TABLE sketch_tbl_' || i;
+  END LOOP;
+END $$;
+\! gpconfig -r gp_relaccess_stats.max_tables > /dev/null
+\! gpconfig -r gp_relaccess_stats.sketch_width > /dev/null
+\! gpconfig -r gp_relaccess_stats.sketch_heavy_hitters > /dev/null
+\! gpstop -ari > /dev/null
+\c